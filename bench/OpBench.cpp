@@ -0,0 +1,95 @@
+/*
+ * chip8_opbench: runs each synthetic single-family program through the core and reports the cost
+ * per emulated instruction, so dispatch and data-layout changes can be judged family by family.
+ *
+ * Usage: chip8_opbench [--cycles <n>] [--runs <n>] [--json <path>] [--emit <dir>]
+ * Build with -DCMAKE_BUILD_TYPE=Release; an unoptimised core mostly measures its own debug overhead.
+ */
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <string.h>
+
+#include "Chip8.h"
+#include "PerfCounters.h"
+#include "RomGenerator.h"
+
+int main(int argc, char* args[])
+{
+    std::string jsonPath = "opbench.json";
+    std::string emitDir;
+    long cycles = 2000000;
+    int runs = 5;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(args[i], "--cycles") == 0) cycles = atol(args[i + 1]);
+        else if (strcmp(args[i], "--runs") == 0) runs = atoi(args[i + 1]);
+        else if (strcmp(args[i], "--json") == 0) jsonPath = args[i + 1];
+        else if (strcmp(args[i], "--emit") == 0) emitDir = args[i + 1];
+    }
+
+    if (runs < 1 || cycles < 1)
+    {
+        std::cerr << "Usage: chip8_opbench [--cycles <n>] [--runs <n>] [--json <path>] [--emit <dir>];"
+                  << " --cycles and --runs must be at least 1" << std::endl;
+        return 1;
+    }
+
+    std::vector<SyntheticRom> roms = GenerateSyntheticRoms();
+
+    PerfCounters perf;
+    if (!perf.AnyAvailable()) std::cerr << "Hardware counters unavailable; reporting wall-clock only" << std::endl;
+
+    std::ofstream json(jsonPath.c_str());
+    json << "{\n  \"cycles\": " << cycles << ",\n  \"runs\": " << runs << ",\n  \"families\": [\n";
+    printf("%-20s %14s %10s %12s %14s\n", "family", "instr/s", "ns/instr", "cycles/instr", "br-miss/instr");
+
+    for (size_t n = 0; n < roms.size(); n++)
+    {
+        if (!emitDir.empty())
+        {
+            std::ofstream out((emitDir + "/" + roms[n].family + ".ch8").c_str(), std::ios::binary);
+            out.write((const char*)roms[n].rom.data(), roms[n].rom.size());
+        }
+
+        Chip8 loaded;
+        loaded.LoadRom(roms[n].rom.data(), roms[n].rom.size());
+
+        // Best of several runs; the minimum is the least disturbed by the rest of the system. Counters
+        // are averaged over all of them
+        double best = 0;
+        perf.Reset();
+        for (int r = 0; r < runs; r++)
+        {
+            Chip8 chip8 = loaded.Clone();
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            perf.Start();
+            for (long c = 0; c < cycles; c++) chip8.Update();
+            perf.Stop();
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            if (r == 0 || seconds < best) best = seconds;
+        }
+
+        double nsPerInstruction = 1e9 * best / cycles;
+        double emulated = (double)cycles * runs;
+        printf("%-20s %14.0f %10.2f", roms[n].family.c_str(), cycles / best, nsPerInstruction);
+        if (perf.Available(PerfCounters::CYCLES)) printf(" %12.1f", perf.Total(PerfCounters::CYCLES) / emulated);
+        else printf(" %12s", "n/a");
+        if (perf.Available(PerfCounters::BRANCH_MISSES)) printf(" %14.3f\n", perf.Total(PerfCounters::BRANCH_MISSES) / emulated);
+        else printf(" %14s\n", "n/a");
+
+        json << "    {\"family\": \"" << roms[n].family << "\", \"ips\": " << cycles / best
+             << ", \"ns_per_instruction\": " << nsPerInstruction << ", \"perf\": ";
+        perf.WriteJson(json, emulated);
+        json << "}" << (n + 1 < roms.size() ? "," : "") << "\n";
+    }
+
+    json << "  ]\n}\n";
+    return 0;
+}
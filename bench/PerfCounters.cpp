@@ -0,0 +1,114 @@
+#include "PerfCounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int OpenCounter(uint32_t type, uint64_t config)
+{
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+PerfCounters::PerfCounters()
+{
+    for (int i = 0; i < COUNTER_COUNT; i++)
+    {
+        fds[i] = -1;
+        totals[i] = 0;
+    }
+
+#ifdef __linux__
+    fds[CYCLES] = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    fds[INSTRUCTIONS] = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    fds[BRANCH_MISSES] = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    fds[L1D_MISSES] = OpenCounter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+            | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+#endif
+}
+
+PerfCounters::~PerfCounters()
+{
+#ifdef __linux__
+    for (int i = 0; i < COUNTER_COUNT; i++)
+    {
+        if (fds[i] >= 0) close(fds[i]);
+    }
+#endif
+}
+
+void PerfCounters::Start()
+{
+#ifdef __linux__
+    for (int i = 0; i < COUNTER_COUNT; i++)
+    {
+        if (fds[i] < 0) continue;
+        ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+void PerfCounters::Stop()
+{
+#ifdef __linux__
+    for (int i = 0; i < COUNTER_COUNT; i++)
+    {
+        if (fds[i] < 0) continue;
+        ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+        uint64_t value = 0;
+        if (read(fds[i], &value, sizeof(value)) == sizeof(value)) totals[i] += value;
+    }
+#endif
+}
+
+void PerfCounters::Reset()
+{
+    for (int i = 0; i < COUNTER_COUNT; i++) totals[i] = 0;
+}
+
+bool PerfCounters::AnyAvailable() const
+{
+    for (int i = 0; i < COUNTER_COUNT; i++)
+    {
+        if (fds[i] >= 0) return true;
+    }
+    return false;
+}
+
+const char* PerfCounters::Name(Counter counter)
+{
+    switch (counter)
+    {
+        case CYCLES: return "cycles";
+        case INSTRUCTIONS: return "host_instructions";
+        case BRANCH_MISSES: return "branch_misses";
+        case L1D_MISSES: return "l1d_misses";
+        default: return "unknown";
+    }
+}
+
+void PerfCounters::WriteJson(std::ostream& out, double emulated) const
+{
+    out << "{";
+    for (int i = 0; i < COUNTER_COUNT; i++)
+    {
+        out << (i ? ", " : "") << "\"" << Name((Counter)i) << "_per_instruction\": ";
+        if (Available((Counter)i)) out << totals[i] / emulated;
+        else out << "null";
+    }
+    out << "}";
+}
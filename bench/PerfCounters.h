@@ -0,0 +1,44 @@
+#pragma once
+
+#include <ostream>
+#include <stdint.h>
+
+/*
+ * Hardware counters around a benchmark run, read through Linux perf_event_open.
+ *
+ * Each counter is opened on its own so a PMU that lacks one (or a container that forbids all of
+ * them) only loses what it can't provide; Available() reports which ones are live and the
+ * harnesses print n/a for the rest.
+ */
+class PerfCounters
+{
+public:
+    enum Counter
+    {
+        CYCLES,
+        INSTRUCTIONS,
+        BRANCH_MISSES,
+        L1D_MISSES,
+        COUNTER_COUNT
+    };
+
+    PerfCounters(void);
+    ~PerfCounters(void);
+
+    // Zero and enable every available counter, then disable them and accumulate into totals
+    void Start(void);
+    void Stop(void);
+    void Reset(void);
+
+    bool Available(Counter counter) const { return fds[counter] >= 0; }
+    bool AnyAvailable(void) const;
+    uint64_t Total(Counter counter) const { return totals[counter]; }
+
+    static const char* Name(Counter counter);
+
+    // "<name>_per_instruction" for every counter divided by the emulated instruction count, null if unavailable
+    void WriteJson(std::ostream& out, double emulated) const;
+private:
+    int fds[COUNTER_COUNT];
+    uint64_t totals[COUNTER_COUNT];
+};
@@ -0,0 +1,197 @@
+/*
+ * chip8_bench: runs every ROM in a directory headless for a fixed number of instructions with
+ * scripted input and reports throughput as JSON.
+ *
+ * Usage: chip8_bench [--roms <dir>] [--cycles <n>] [--runs <n>] [--json <path>] [--engine <name>]
+ *                    [--quirks <profile>] [--bounds <wrap|fault>]
+ * --engine picks the execution engine (default: reference); engine statistics from the last run of
+ * each ROM are printed after the table. --quirks picks the quirk profile (default: default)
+ * and --bounds what out-of-range accesses do (default: wrap).
+ * Numbers are only meaningful from a build configured with -DCMAKE_BUILD_TYPE=Release.
+ */
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <string.h>
+
+#include "Chip8.h"
+#include "Engine.h"
+#include "PerfCounters.h"
+#include "RomScript.h"
+
+struct RomResult
+{
+    std::string name;
+    std::vector<double> seconds;
+    std::string perfJson;
+    std::string engineReport;
+    double cyclesPerInstruction;
+    double branchMissesPerInstruction;
+};
+
+static double RunOnce(const Chip8& loaded, long frames, Engine& engine, PerfCounters& perf)
+{
+    Chip8 chip8 = loaded.Clone();
+    engine.Reset();
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    perf.Start();
+    for (long frame = 0; frame < frames; frame++)
+    {
+        ScriptInput(chip8, frame);
+        engine.Run(chip8, Chip8::CYCLES_PER_FRAME);
+    }
+    perf.Stop();
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double>(end - start).count();
+}
+
+static void Stats(const std::vector<double>& values, double& mean, double& stddev)
+{
+    mean = 0;
+    for (size_t i = 0; i < values.size(); i++) mean += values[i];
+    mean /= values.size();
+
+    stddev = 0;
+    for (size_t i = 0; i < values.size(); i++) stddev += (values[i] - mean) * (values[i] - mean);
+    stddev = values.size() > 1 ? std::sqrt(stddev / (values.size() - 1)) : 0;
+}
+
+int main(int argc, char* args[])
+{
+    std::string romDir = "roms";
+    std::string jsonPath = "bench.json";
+    std::string engineName = "reference";
+    std::string quirksName = "default";
+    std::string boundsName = "wrap";
+    long cycles = 2000000;
+    int runs = 5;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(args[i], "--roms") == 0) romDir = args[i + 1];
+        else if (strcmp(args[i], "--cycles") == 0) cycles = atol(args[i + 1]);
+        else if (strcmp(args[i], "--runs") == 0) runs = atoi(args[i + 1]);
+        else if (strcmp(args[i], "--json") == 0) jsonPath = args[i + 1];
+        else if (strcmp(args[i], "--engine") == 0) engineName = args[i + 1];
+        else if (strcmp(args[i], "--quirks") == 0) quirksName = args[i + 1];
+        else if (strcmp(args[i], "--bounds") == 0) boundsName = args[i + 1];
+    }
+
+    if (runs < 1 || cycles < 1)
+    {
+        std::cerr << "Usage: chip8_bench [--roms <dir>] [--cycles <n>] [--runs <n>] [--json <path>] [--engine <name>]"
+                  << " [--quirks <profile>] [--bounds <wrap|fault>]; --cycles and --runs must be at least 1" << std::endl;
+        return 1;
+    }
+
+    if (!Engine::Create(engineName))
+    {
+        std::cerr << "Unknown engine " << engineName << std::endl;
+        return 1;
+    }
+
+    QuirkProfile quirks;
+    if (!ParseQuirkProfile(quirksName, quirks))
+    {
+        std::cerr << "Unknown quirk profile " << quirksName << std::endl;
+        return 1;
+    }
+
+    BoundsMode bounds;
+    if (!ParseBoundsMode(boundsName, bounds))
+    {
+        std::cerr << "Unknown bounds mode " << boundsName << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> names;
+    if (!ListRoms(romDir, names))
+    {
+        std::cerr << "Failed to open ROM directory " << romDir << std::endl;
+        return 1;
+    }
+
+    long frames = (cycles + Chip8::CYCLES_PER_FRAME - 1) / Chip8::CYCLES_PER_FRAME;
+    cycles = frames * Chip8::CYCLES_PER_FRAME;
+
+    PerfCounters perf;
+    if (!perf.AnyAvailable()) std::cerr << "Hardware counters unavailable; reporting wall-clock only" << std::endl;
+
+    std::vector<RomResult> results;
+    for (size_t n = 0; n < names.size(); n++)
+    {
+        Chip8 loaded;
+        if (!loaded.LoadRom((romDir + "/" + names[n]).c_str())) continue;
+        loaded.SetQuirks(quirks);
+        loaded.SetBounds(bounds);
+
+        RomResult result;
+        result.name = names[n];
+
+        // One untimed run to warm caches and the branch predictor
+        std::unique_ptr<Engine> engine = Engine::Create(engineName);
+        RunOnce(loaded, frames / 10, *engine, perf);
+        perf.Reset();
+        for (int r = 0; r < runs; r++)
+        {
+            engine = Engine::Create(engineName);
+            result.seconds.push_back(RunOnce(loaded, frames, *engine, perf));
+        }
+
+        std::ostringstream engineReport;
+        engine->WriteReport(engineReport);
+        result.engineReport = engineReport.str();
+
+        double emulated = (double)cycles * runs;
+        std::ostringstream perfJson;
+        perf.WriteJson(perfJson, emulated);
+        result.perfJson = perfJson.str();
+        result.cyclesPerInstruction = perf.Available(PerfCounters::CYCLES) ? perf.Total(PerfCounters::CYCLES) / emulated : -1;
+        result.branchMissesPerInstruction = perf.Available(PerfCounters::BRANCH_MISSES) ? perf.Total(PerfCounters::BRANCH_MISSES) / emulated : -1;
+
+        results.push_back(result);
+    }
+
+    std::ofstream json(jsonPath.c_str());
+    json << "{\n  \"engine\": \"" << engineName << "\",\n  \"quirks\": \"" << quirksName << "\",\n  \"bounds\": \"" << boundsName << "\",\n  \"cycles\": " << cycles << ",\n  \"runs\": " << runs << ",\n  \"roms\": [\n";
+
+    printf("%-16s %14s %10s %12s %8s %12s %14s\n", "ROM", "instr/s", "ns/instr", "frames/s", "cv %", "cycles/instr", "br-miss/instr");
+    for (size_t n = 0; n < results.size(); n++)
+    {
+        std::vector<double> ips;
+        for (size_t r = 0; r < results[n].seconds.size(); r++) ips.push_back(cycles / results[n].seconds[r]);
+
+        double mean, stddev;
+        Stats(ips, mean, stddev);
+
+        printf("%-16s %14.0f %10.2f %12.0f %8.2f", results[n].name.c_str(), mean, 1e9 / mean,
+               mean / Chip8::CYCLES_PER_FRAME, 100 * stddev / mean);
+        if (results[n].cyclesPerInstruction >= 0) printf(" %12.1f", results[n].cyclesPerInstruction);
+        else printf(" %12s", "n/a");
+        if (results[n].branchMissesPerInstruction >= 0) printf(" %14.3f\n", results[n].branchMissesPerInstruction);
+        else printf(" %14s\n", "n/a");
+
+        json << "    {\"name\": \"" << results[n].name << "\", \"ips_mean\": " << mean
+             << ", \"ips_stddev\": " << stddev << ", \"ips_variance\": " << stddev * stddev
+             << ", \"ns_per_instruction\": " << 1e9 / mean
+             << ", \"frames_per_second\": " << mean / Chip8::CYCLES_PER_FRAME
+             << ", \"perf\": " << results[n].perfJson << ", \"ips_runs\": [";
+        for (size_t r = 0; r < ips.size(); r++) json << (r ? ", " : "") << ips[r];
+        json << "]}" << (n + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    json << "  ]\n}\n";
+
+    for (size_t n = 0; n < results.size(); n++)
+    {
+        if (!results[n].engineReport.empty()) std::cout << "\n" << results[n].name << " (" << engineName << ")\n" << results[n].engineReport;
+    }
+    return 0;
+}
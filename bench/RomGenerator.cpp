@@ -0,0 +1,152 @@
+#include "RomGenerator.h"
+
+// Times the body of each loop is repeated before jumping back
+static const int UNROLL = 32;
+
+class Assembler
+{
+public:
+    uint16_t Here(void) const { return 0x200 + (uint16_t)rom.size(); }
+
+    void Emit(uint16_t opcode)
+    {
+        rom.push_back(opcode >> 8);
+        rom.push_back(opcode & 0xFF);
+    }
+
+    // Patch a previously emitted nnn-style instruction once its target is known
+    void Patch(uint16_t at, uint16_t opcode)
+    {
+        rom[at - 0x200] = opcode >> 8;
+        rom[at - 0x200 + 1] = opcode & 0xFF;
+    }
+
+    std::vector<uint8_t> rom;
+};
+
+static SyntheticRom Alu()
+{
+    Assembler a;
+    for (int x = 0; x < 8; x++) a.Emit(0x6000 | (x << 8) | (0x11 * (x + 1)));
+
+    static const uint8_t ops[] = {0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE};
+    uint16_t loop = a.Here();
+    for (int i = 0; i < UNROLL; i++)
+    {
+        int x = i % 8;
+        int y = (i + 3) % 8;
+        a.Emit(0x8000 | (x << 8) | (y << 4) | ops[i % 9]);
+    }
+    a.Emit(0x1000 | loop);
+
+    SyntheticRom result = {"alu_8xyN", a.rom};
+    return result;
+}
+
+// Sprites from the font at a spread of positions, including ones that wrap off the right and bottom edges
+static SyntheticRom Draw(int rows)
+{
+    Assembler a;
+    static const uint8_t coords[] = {0, 0, 10, 5, 30, 12, 56, 20, 60, 30, 63, 31, 17, 27, 44, 2};
+    for (int r = 0; r < 16; r++) a.Emit(0x6000 | (r << 8) | coords[r]);
+    a.Emit(0xA000);
+
+    uint16_t loop = a.Here();
+    for (int i = 0; i < UNROLL; i++)
+    {
+        int pair = i % 8;
+        a.Emit(0xD000 | ((2 * pair) << 8) | ((2 * pair + 1) << 4) | rows);
+    }
+    a.Emit(0x1000 | loop);
+
+    SyntheticRom result = {"draw_" + std::to_string(rows) + "_rows", a.rom};
+    return result;
+}
+
+// A chain of subroutines eight calls deep, each calling the next and returning
+static SyntheticRom Calls()
+{
+    const int depth = 8;
+    Assembler a;
+
+    uint16_t loop = a.Here();
+    uint16_t call = a.Here();
+    a.Emit(0x2000);
+    a.Emit(0x1000 | loop);
+
+    for (int d = 0; d < depth; d++)
+    {
+        a.Patch(call, 0x2000 | a.Here());
+        if (d + 1 < depth)
+        {
+            call = a.Here();
+            a.Emit(0x2000);
+        }
+        a.Emit(0x00EE);
+    }
+
+    SyntheticRom result = {"call_2nnn_00EE", a.rom};
+    return result;
+}
+
+static SyntheticRom BlockMove()
+{
+    Assembler a;
+    a.Emit(0xA800);
+
+    uint16_t loop = a.Here();
+    for (int i = 0; i < UNROLL; i++) a.Emit(i % 2 == 0 ? 0xFF55 : 0xFF65);
+    a.Emit(0x1000 | loop);
+
+    SyntheticRom result = {"block_FX55_FX65", a.rom};
+    return result;
+}
+
+static SyntheticRom Bcd()
+{
+    Assembler a;
+    for (int x = 0; x < 16; x++) a.Emit(0x6000 | (x << 8) | (x * 17));
+    a.Emit(0xA800);
+
+    uint16_t loop = a.Here();
+    for (int i = 0; i < UNROLL; i++) a.Emit(0xF033 | ((i % 16) << 8));
+    a.Emit(0x1000 | loop);
+
+    SyntheticRom result = {"bcd_FX33", a.rom};
+    return result;
+}
+
+// Alternates taken and not-taken skips of every form; the skipped-over instructions are all 6xkk
+static SyntheticRom Branches()
+{
+    Assembler a;
+    a.Emit(0x6000);
+    a.Emit(0x6100);
+    a.Emit(0x6201);
+
+    static const uint16_t skips[] = {0x3000, 0x3001, 0x4001, 0x4000, 0x5010, 0x5020, 0x9020, 0x9010};
+    uint16_t loop = a.Here();
+    for (int i = 0; i < UNROLL; i++)
+    {
+        a.Emit(skips[i % 8]);
+        a.Emit(0x6300);
+    }
+    a.Emit(0x1000 | loop);
+
+    SyntheticRom result = {"skip_3x_4x_5x_9x", a.rom};
+    return result;
+}
+
+std::vector<SyntheticRom> GenerateSyntheticRoms()
+{
+    std::vector<SyntheticRom> roms;
+    roms.push_back(Alu());
+    roms.push_back(Draw(1));
+    roms.push_back(Draw(5));
+    roms.push_back(Draw(15));
+    roms.push_back(Calls());
+    roms.push_back(BlockMove());
+    roms.push_back(Bcd());
+    roms.push_back(Branches());
+    return roms;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// A generated CHIP-8 program that spends nearly all of its time in one instruction family
+struct SyntheticRom
+{
+    std::string family;
+    std::vector<uint8_t> rom;
+};
+
+/*
+ * Builds one program per family: 8xyN ALU chains, Dxyn at several sizes and screen offsets,
+ * 2nnn/00EE call chains, FX55/FX65 block moves, FX33 BCD and 3xkk/4xkk/5xy0/9xy0 skips. Each is
+ * a short setup followed by an unrolled body and a 1nnn back to it, so it runs forever and the
+ * loop overhead is a few percent of the instructions executed.
+ */
+std::vector<SyntheticRom> GenerateSyntheticRoms(void);
@@ -0,0 +1,293 @@
+#include "Analysis.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <utility>
+
+#include "Instructions.h"
+
+// Adds the next pcs the instruction alone determines; returns true if it ends a block
+static bool Successors(uint16_t address, uint16_t opcode, std::vector<uint16_t>& next, bool& indirect)
+{
+    uint16_t nnn = opcode & 0xFFF;
+    indirect = false;
+    switch (Instructions::Decode(opcode))
+    {
+        case Instructions::JP_1NNN:
+            next.push_back(nnn);
+            return true;
+
+        // The return site is assumed to be reached once the subroutine returns
+        case Instructions::CALL_2NNN:
+            next.push_back(nnn);
+            next.push_back(address + 2);
+            return true;
+
+        case Instructions::SE_3XKK:
+        case Instructions::SNE_4XKK:
+        case Instructions::SE_5XY0:
+        case Instructions::SNE_9XY0:
+        case Instructions::SKP_EX9E:
+        case Instructions::SKNP_EXA1:
+            next.push_back(address + 2);
+            next.push_back(address + 4);
+            return true;
+
+        case Instructions::RET_00EE:
+        case Instructions::JP_BNNN:
+            indirect = true;
+            return true;
+
+        // pc stays put with no key held and moves on by 2 for each held key, 2 being the usual case
+        case Instructions::LD_FX0A:
+            indirect = true;
+            next.push_back(address);
+            next.push_back(address + 2);
+            return true;
+
+        case Instructions::BCD_FX33:
+        case Instructions::LD_FX55:
+            next.push_back(address + 2);
+            return true;
+
+        case Instructions::FALLBACK:
+            return true;
+
+        default:
+            next.push_back(address + 2);
+            return false;
+    }
+}
+
+ControlFlowGraph::ControlFlowGraph(const uint8_t* data, size_t size, uint16_t start)
+    : image(data, data + size), origin(start)
+{
+    memset(instruction, 0, sizeof(instruction));
+    memset(leader, 0, sizeof(leader));
+    memset(subroutine, 0, sizeof(subroutine));
+    memset(loopHeader, 0, sizeof(loopHeader));
+    memset(sprite, 0, sizeof(sprite));
+
+    Descend(origin);
+    Split();
+    FollowIndex();
+    FindLoops();
+}
+
+uint16_t ControlFlowGraph::Opcode(uint16_t address) const
+{
+    if (!Contains(address, 2)) return 0;
+    return (image[address - origin] << 8) | image[address - origin + 1];
+}
+
+void ControlFlowGraph::Descend(uint16_t entry)
+{
+    std::vector<uint16_t> work(1, entry);
+    if (Contains(entry, 2)) leader[entry] = true;
+
+    std::vector<uint16_t> next;
+    while (!work.empty())
+    {
+        uint16_t address = work.back();
+        work.pop_back();
+        if (!Contains(address, 2) || instruction[address]) continue;
+
+        uint16_t opcode = Opcode(address);
+        Instructions::Kind kind = Instructions::Decode(opcode);
+        if (kind == Instructions::FALLBACK) continue;
+        instruction[address] = true;
+        if (kind == Instructions::CALL_2NNN && Contains(opcode & 0xFFF, 2)) subroutine[opcode & 0xFFF] = true;
+
+        bool indirect;
+        next.clear();
+        bool ends = Successors(address, opcode, next, indirect);
+        for (size_t i = 0; i < next.size(); i++)
+        {
+            if (!Contains(next[i], 2)) continue;
+            if (ends) leader[next[i]] = true;
+            work.push_back(next[i]);
+        }
+    }
+}
+
+// Every instruction is reached from a leader by fall-through, so walking from each leader covers them all
+void ControlFlowGraph::Split()
+{
+    for (int address = 0; address < 4096; address++)
+    {
+        if (!leader[address] || !instruction[address]) continue;
+
+        Block block;
+        block.start = address;
+        block.length = 0;
+        block.indirect = false;
+
+        uint16_t at = address;
+        while (true)
+        {
+            block.length++;
+            if (Successors(at, Opcode(at), block.successors, block.indirect)) break;
+
+            // Fall-through into another block or into something that is not code
+            uint16_t next = at + 2;
+            if (!IsInstruction(next) || leader[next]) break;
+
+            block.successors.clear();
+            at = next;
+        }
+        blocks.push_back(block);
+    }
+}
+
+bool ControlFlowGraph::IsSkipGuarded(uint16_t address) const
+{
+    if (!IsInstruction(address) || !IsInstruction(address - 2)) return false;
+    switch (Instructions::Decode(Opcode(address - 2)))
+    {
+        case Instructions::SE_3XKK:
+        case Instructions::SNE_4XKK:
+        case Instructions::SE_5XY0:
+        case Instructions::SNE_9XY0:
+        case Instructions::SKP_EX9E:
+        case Instructions::SKNP_EXA1:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void ControlFlowGraph::FollowIndex()
+{
+    for (size_t b = 0; b < blocks.size(); b++)
+    {
+        bool known = false;
+        uint16_t index = 0;
+        for (int k = 0; k < blocks[b].length; k++)
+        {
+            uint16_t address = blocks[b].start + 2 * k;
+            uint16_t opcode = Opcode(address);
+            Instructions::Kind kind = Instructions::Decode(opcode);
+
+            if (kind == Instructions::DRW_DXYN && known)
+            {
+                for (int i = 0; i < (opcode & 0xF); i++) sprite[(index + i) & 0xFFF] = true;
+            }
+            if (kind == Instructions::BCD_FX33 || kind == Instructions::LD_FX55)
+            {
+                Store store;
+                store.address = address;
+                store.known = known;
+                store.target = index;
+                store.length = kind == Instructions::BCD_FX33 ? 3 : ((opcode >> 8) & 0xF) + 1;
+                store.hitsCode = false;
+                for (int i = 0; known && i < store.length; i++) store.hitsCode |= IsCode((index + i) & 0xFFF);
+                stores.push_back(store);
+            }
+
+            if (kind == Instructions::LD_ANNN)
+            {
+                known = true;
+                index = opcode & 0xFFF;
+            }
+            else if (kind == Instructions::ADD_FX1E || kind == Instructions::LD_FX29 || kind == Instructions::LD_FX55 ||
+                     kind == Instructions::LD_FX65)
+            {
+                known = false;
+            }
+        }
+    }
+}
+
+// Iterative depth-first walk over the blocks, from the entry and then from any block not yet seen
+void ControlFlowGraph::FindLoops()
+{
+    std::vector<int> blockAt(4096, -1);
+    for (size_t b = 0; b < blocks.size(); b++) blockAt[blocks[b].start] = b;
+
+    enum { UNSEEN, OPEN, CLOSED };
+    std::vector<uint8_t> state(blocks.size(), UNSEEN);
+
+    std::vector<int> roots(1, origin < 4096 ? blockAt[origin] : -1);
+    for (size_t b = 0; b < blocks.size(); b++) roots.push_back(b);
+
+    // Each entry is a block on the current path and the next of its successors to follow
+    std::vector<std::pair<int, size_t> > path;
+    for (size_t r = 0; r < roots.size(); r++)
+    {
+        int first = roots[r];
+        if (first < 0 || state[first] != UNSEEN) continue;
+
+        state[first] = OPEN;
+        path.push_back(std::make_pair(first, 0));
+        while (!path.empty())
+        {
+            int b = path.back().first;
+            size_t& next = path.back().second;
+            if (next == blocks[b].successors.size())
+            {
+                state[b] = CLOSED;
+                path.pop_back();
+                continue;
+            }
+
+            uint16_t target = blocks[b].successors[next++];
+            int t = target < 4096 ? blockAt[target] : -1;
+            if (t < 0) continue;
+            if (state[t] == OPEN) loopHeader[target] = true;
+            if (state[t] != UNSEEN) continue;
+
+            state[t] = OPEN;
+            path.push_back(std::make_pair(t, 0));
+        }
+    }
+}
+
+std::string Disassemble(uint16_t opcode)
+{
+    int x = (opcode >> 8) & 0xF;
+    int y = (opcode >> 4) & 0xF;
+    int n = opcode & 0xF;
+    int kk = opcode & 0xFF;
+    int nnn = opcode & 0xFFF;
+
+    char text[32];
+    switch (Instructions::Decode(opcode))
+    {
+        case Instructions::CLS_00E0: return "CLS";
+        case Instructions::RET_00EE: return "RET";
+        case Instructions::JP_1NNN: snprintf(text, sizeof(text), "JP 0x%03X", nnn); break;
+        case Instructions::CALL_2NNN: snprintf(text, sizeof(text), "CALL 0x%03X", nnn); break;
+        case Instructions::SE_3XKK: snprintf(text, sizeof(text), "SE V%X, 0x%02X", x, kk); break;
+        case Instructions::SNE_4XKK: snprintf(text, sizeof(text), "SNE V%X, 0x%02X", x, kk); break;
+        case Instructions::SE_5XY0: snprintf(text, sizeof(text), "SE V%X, V%X", x, y); break;
+        case Instructions::LD_6XKK: snprintf(text, sizeof(text), "LD V%X, 0x%02X", x, kk); break;
+        case Instructions::ADD_7XKK: snprintf(text, sizeof(text), "ADD V%X, 0x%02X", x, kk); break;
+        case Instructions::LD_8XY0: snprintf(text, sizeof(text), "LD V%X, V%X", x, y); break;
+        case Instructions::OR_8XY1: snprintf(text, sizeof(text), "OR V%X, V%X", x, y); break;
+        case Instructions::AND_8XY2: snprintf(text, sizeof(text), "AND V%X, V%X", x, y); break;
+        case Instructions::XOR_8XY3: snprintf(text, sizeof(text), "XOR V%X, V%X", x, y); break;
+        case Instructions::ADD_8XY4: snprintf(text, sizeof(text), "ADD V%X, V%X", x, y); break;
+        case Instructions::SUB_8XY5: snprintf(text, sizeof(text), "SUB V%X, V%X", x, y); break;
+        case Instructions::SHR_8XY6: snprintf(text, sizeof(text), "SHR V%X, V%X", x, y); break;
+        case Instructions::SUBN_8XY7: snprintf(text, sizeof(text), "SUBN V%X, V%X", x, y); break;
+        case Instructions::SHL_8XYE: snprintf(text, sizeof(text), "SHL V%X, V%X", x, y); break;
+        case Instructions::SNE_9XY0: snprintf(text, sizeof(text), "SNE V%X, V%X", x, y); break;
+        case Instructions::LD_ANNN: snprintf(text, sizeof(text), "LD I, 0x%03X", nnn); break;
+        case Instructions::JP_BNNN: snprintf(text, sizeof(text), "JP V0, 0x%03X", nnn); break;
+        case Instructions::RND_CXKK: snprintf(text, sizeof(text), "RND V%X, 0x%02X", x, kk); break;
+        case Instructions::DRW_DXYN: snprintf(text, sizeof(text), "DRW V%X, V%X, %d", x, y, n); break;
+        case Instructions::SKP_EX9E: snprintf(text, sizeof(text), "SKP V%X", x); break;
+        case Instructions::SKNP_EXA1: snprintf(text, sizeof(text), "SKNP V%X", x); break;
+        case Instructions::LD_FX07: snprintf(text, sizeof(text), "LD V%X, DT", x); break;
+        case Instructions::LD_FX0A: snprintf(text, sizeof(text), "LD V%X, K", x); break;
+        case Instructions::LD_FX15: snprintf(text, sizeof(text), "LD DT, V%X", x); break;
+        case Instructions::LD_FX18: snprintf(text, sizeof(text), "LD ST, V%X", x); break;
+        case Instructions::ADD_FX1E: snprintf(text, sizeof(text), "ADD I, V%X", x); break;
+        case Instructions::LD_FX29: snprintf(text, sizeof(text), "LD F, V%X", x); break;
+        case Instructions::BCD_FX33: snprintf(text, sizeof(text), "LD B, V%X", x); break;
+        case Instructions::LD_FX55: snprintf(text, sizeof(text), "LD [I], V%X", x); break;
+        case Instructions::LD_FX65: snprintf(text, sizeof(text), "LD V%X, [I]", x); break;
+        default: snprintf(text, sizeof(text), "DW 0x%04X", opcode); break;
+    }
+    return text;
+}
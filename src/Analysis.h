@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+ * Static control-flow recovery for ROM images
+ *
+ * ControlFlowGraph finds the code in a ROM by recursive descent from its entry point, following
+ * jumps, both ways out of every skip, calls and the instruction after them, and plain fall-through.
+ * Descent stops at opcodes Update does not know and at addresses outside the image. Bytes of the
+ * image no instruction covers are data; those a Dxyn draws from a statically known I are sprites.
+ *
+ * It only sees what the bytes say. Bnnn targets depend on a register and are left unresolved, as
+ * are returns and FX0A, whose next pc depends on the stack and the keypad; code the ROM writes at
+ * run time is not there to be found. Anything built on the graph has to fall back to running the
+ * machine for those.
+ *
+ * A block ends at the first instruction that can change the flow of control or write memory
+ * (FX33, FX55), or before the next block's first instruction, so that a store which turns out to
+ * hit code is always followed by a block boundary.
+ *
+ * I is followed through each block from the Annn that sets it, so stores and draws whose address
+ * is an Annn earlier in the same block are known statically; anything else that touches I (FX1E,
+ * FX29, and FX55/FX65, whose step is a quirk) makes it unknown until the next Annn.
+ */
+class ControlFlowGraph
+{
+public:
+    struct Block
+    {
+        uint16_t start;
+
+        // Number of instructions; the block covers bytes [start, start + 2 * length)
+        uint16_t length;
+
+        // Statically known next pcs, in or outside the image
+        std::vector<uint16_t> successors;
+
+        // Set when the next pc also depends on the machine state (Bnnn, 00EE, FX0A)
+        bool indirect;
+    };
+
+    // An FX33 or FX55 and what it writes
+    struct Store
+    {
+        uint16_t address;
+
+        // Whether I is known here; target and length are only meaningful if so
+        bool known;
+        uint16_t target;
+        uint16_t length;
+
+        // Whether the bytes written, wrapped to 12 bits, include bytes of instructions; a store
+        // whose target is not known may hit code as well
+        bool hitsCode;
+    };
+
+    // The image is placed at `origin`; descent starts there
+    ControlFlowGraph(const uint8_t* image, size_t size, uint16_t origin = 0x200);
+
+    // Ordered by start address
+    const std::vector<Block>& Blocks(void) const { return blocks; }
+
+    // Ordered by address
+    const std::vector<Store>& Stores(void) const { return stores; }
+
+    // Whether an instruction was found starting at `address`
+    bool IsInstruction(uint16_t address) const { return address < 4096 && instruction[address]; }
+
+    // Whether `address` is either byte of an instruction
+    bool IsCode(uint16_t address) const { return IsInstruction(address) || (address > 0 && IsInstruction(address - 1)); }
+
+    // Whether `address` starts a block
+    bool IsLeader(uint16_t address) const { return address < 4096 && leader[address]; }
+
+    // Whether a 2nnn calls `address`
+    bool IsSubroutine(uint16_t address) const { return address < 4096 && subroutine[address]; }
+
+    // Whether `address` starts a block that an edge of a depth-first walk from the entry leads
+    // back to, which makes it the head of a loop
+    bool IsLoopHeader(uint16_t address) const { return address < 4096 && loopHeader[address]; }
+
+    // Whether the instruction at `address` directly follows a skip, so it may not run
+    bool IsSkipGuarded(uint16_t address) const;
+
+    // Whether a Dxyn with a statically known I draws the byte at `address`
+    bool IsSprite(uint16_t address) const { return address < 4096 && sprite[address]; }
+
+    // The two bytes at `address`, or 0 outside the image
+    uint16_t Opcode(uint16_t address) const;
+
+    uint16_t Origin(void) const { return origin; }
+    size_t Size(void) const { return image.size(); }
+private:
+    bool Contains(uint16_t address, int bytes) const { return address >= origin && address + (size_t)bytes <= origin + image.size(); }
+
+    void Descend(uint16_t entry);
+    void Split(void);
+    void FollowIndex(void);
+    void FindLoops(void);
+
+    std::vector<uint8_t> image;
+    uint16_t origin;
+    bool instruction[4096];
+    bool leader[4096];
+    bool subroutine[4096];
+    bool loopHeader[4096];
+    bool sprite[4096];
+    std::vector<Block> blocks;
+    std::vector<Store> stores;
+};
+
+// The instruction in the usual assembler notation, e.g. "LD V3, 0x0A" or "DRW V0, V1, 5"; opcodes
+// Update does not know come out as "DW 0x0123"
+std::string Disassemble(uint16_t opcode);
@@ -0,0 +1,449 @@
+#include "BlockEngine.h"
+
+#include <iomanip>
+#include <string.h>
+
+// Instructions after which the next pc is not simply pc + 2, or after which memory may have changed
+static bool EndsBlock(int kind)
+{
+    switch (kind)
+    {
+        case Instructions::RET_00EE:
+        case Instructions::JP_1NNN:
+        case Instructions::CALL_2NNN:
+        case Instructions::SE_3XKK:
+        case Instructions::SNE_4XKK:
+        case Instructions::SE_5XY0:
+        case Instructions::SNE_9XY0:
+        case Instructions::JP_BNNN:
+        case Instructions::SKP_EX9E:
+        case Instructions::SKNP_EXA1:
+        case Instructions::LD_FX0A:
+        case Instructions::BCD_FX33:
+        case Instructions::LD_FX55:
+        case Instructions::FALLBACK:
+            return true;
+        default:
+            return false;
+    }
+}
+
+BlockEngine::BlockEngine()
+{
+    built = 0;
+    invalidated = 0;
+    chained = 0;
+    lookedUp = 0;
+    executed = 0;
+    flagOps = 0;
+    flagsRemoved = 0;
+    epoch = 0;
+    machine = nullptr;
+    memset(pageBlocks, 0, sizeof(pageBlocks));
+    memset(codeBytes, 0, sizeof(codeBytes));
+}
+
+void BlockEngine::Reset()
+{
+    machine = nullptr;
+}
+
+void BlockEngine::Flush(const Chip8& chip8)
+{
+    for (int i = 0; i < 4096; i++) blocks[i].reset();
+    memset(codeBytes, 0, sizeof(codeBytes));
+    for (int page = 0; page < Chip8::PAGE_COUNT; page++)
+    {
+        pageBlocks[page] = 0;
+        decodedVersions[page] = chip8.PageVersion(page);
+    }
+    decodedMemoryVersion = chip8.MemoryVersion();
+    epoch++;
+}
+
+void BlockEngine::Drop(int page)
+{
+    for (int i = 0; i < Chip8::PAGE_SIZE; i++)
+    {
+        blocks[(page << 8) | i].reset();
+        codeBytes[(page << 8) | i] = false;
+    }
+    pageBlocks[page] = 0;
+    invalidated++;
+}
+
+bool BlockEngine::Sync(const Chip8& chip8)
+{
+    if (decodedMemoryVersion == chip8.MemoryVersion()) return false;
+    decodedMemoryVersion = chip8.MemoryVersion();
+
+    // Writes to pages without blocks, such as sprite and score data, cost nothing beyond this check
+    bool dropped = false;
+    for (int page = 0; page < Chip8::PAGE_COUNT; page++)
+    {
+        if (decodedVersions[page] == chip8.PageVersion(page)) continue;
+        decodedVersions[page] = chip8.PageVersion(page);
+        if (pageBlocks[page] == 0) continue;
+
+        Drop(page);
+        dropped = true;
+    }
+
+    if (dropped) epoch++;
+    return dropped;
+}
+
+bool BlockEngine::Stored(const Chip8& chip8, uint16_t address, int count)
+{
+    bool dropped = false;
+    for (int i = 0; i < count; i++)
+    {
+        uint16_t written = (address + i) & 0xFFF;
+        if (!codeBytes[written]) continue;
+
+        Drop(written >> 8);
+        dropped = true;
+    }
+
+    // Nothing else wrote since the last check, so every other change is to data and can be accepted
+    for (int page = 0; page < Chip8::PAGE_COUNT; page++) decodedVersions[page] = chip8.PageVersion(page);
+    decodedMemoryVersion = chip8.MemoryVersion();
+
+    if (dropped) epoch++;
+    return dropped;
+}
+
+BlockEngine::Block* BlockEngine::Build(const Chip8& chip8, uint16_t address)
+{
+    Block* block = new Block();
+    block->writes = false;
+    block->deadFlags = false;
+    block->nextLink = 0;
+    memset(block->links, 0, sizeof(block->links));
+
+    for (uint16_t at = address; ((at >> 8) & 0xF) == (address >> 8); at += 2)
+    {
+        Op op;
+        memset(&op, 0, sizeof(op));
+
+        // An opcode split across two pages is left to Update, alone in its block
+        if ((at & 0xFF) == 0xFF)
+        {
+            if (!block->ops.empty()) break;
+            op.kind = Instructions::FALLBACK;
+            block->ops.push_back(op);
+            block->writes = true;
+            break;
+        }
+
+        uint16_t opcode = Instructions::Fetch(chip8, at);
+        op.kind = Instructions::Decode(opcode);
+        op.x = (opcode >> 8) & 0xF;
+        op.y = (opcode >> 4) & 0xF;
+        op.n = opcode & 0xF;
+        op.kk = opcode & 0xFF;
+        op.nnn = opcode & 0xFFF;
+        block->ops.push_back(op);
+        codeBytes[at] = true;
+        codeBytes[at + 1] = true;
+
+        if (EndsBlock(op.kind))
+        {
+            block->writes = op.kind == Instructions::BCD_FX33 || op.kind == Instructions::LD_FX55
+                            || op.kind == Instructions::FALLBACK;
+            break;
+        }
+    }
+
+    RemoveDeadFlags(block);
+
+    blocks[address].reset(block);
+    pageBlocks[address >> 8]++;
+    built++;
+    return block;
+}
+
+// Whether the op may read VF under any quirk profile; Update is assumed to read everything
+bool BlockEngine::ReadsFlag(const Op& op)
+{
+    switch (op.kind)
+    {
+        case Instructions::CLS_00E0:
+        case Instructions::RET_00EE:
+        case Instructions::JP_1NNN:
+        case Instructions::CALL_2NNN:
+        case Instructions::LD_6XKK:
+        case Instructions::LD_ANNN:
+        case Instructions::RND_CXKK:
+        case Instructions::LD_FX07:
+        case Instructions::LD_FX0A:
+        case Instructions::LD_FX65:
+            return false;
+
+        case Instructions::SE_3XKK:
+        case Instructions::SNE_4XKK:
+        case Instructions::ADD_7XKK:
+        case Instructions::JP_BNNN:
+        case Instructions::SKP_EX9E:
+        case Instructions::SKNP_EXA1:
+        case Instructions::LD_FX15:
+        case Instructions::LD_FX18:
+        case Instructions::ADD_FX1E:
+        case Instructions::LD_FX29:
+        case Instructions::BCD_FX33:
+        case Instructions::LD_FX55:
+            return op.x == 0xF;
+
+        case Instructions::LD_8XY0:
+            return op.y == 0xF;
+
+        case Instructions::SE_5XY0:
+        case Instructions::OR_8XY1:
+        case Instructions::AND_8XY2:
+        case Instructions::XOR_8XY3:
+        case Instructions::ADD_8XY4:
+        case Instructions::SUB_8XY5:
+        case Instructions::SHR_8XY6:
+        case Instructions::SUBN_8XY7:
+        case Instructions::SHL_8XYE:
+        case Instructions::SNE_9XY0:
+        case Instructions::DRW_DXYN:
+            return op.x == 0xF || op.y == 0xF;
+
+        default:
+            return true;
+    }
+}
+
+// Whether the op sets VF under every quirk profile, whatever it held before
+bool BlockEngine::OverwritesFlag(const Op& op)
+{
+    switch (op.kind)
+    {
+        case Instructions::ADD_8XY4:
+        case Instructions::SUB_8XY5:
+        case Instructions::SHR_8XY6:
+        case Instructions::SUBN_8XY7:
+        case Instructions::SHL_8XYE:
+        case Instructions::DRW_DXYN:
+            return true;
+
+        case Instructions::LD_6XKK:
+        case Instructions::RND_CXKK:
+        case Instructions::LD_FX07:
+        case Instructions::LD_FX65:
+            return op.x == 0xF;
+
+        case Instructions::LD_8XY0:
+            return op.x == 0xF && op.y != 0xF;
+
+        default:
+            return false;
+    }
+}
+
+// The flag-setting kind a dead-flag kind was made from; both runs keep the order of Instructions::Kind
+int BlockEngine::EagerKind(int kind)
+{
+    return kind >= ADD_8XY4_NO_VF ? Instructions::ADD_8XY4 + (kind - ADD_8XY4_NO_VF) : kind;
+}
+
+// Backward liveness over the block, with VF live at its exit
+void BlockEngine::RemoveDeadFlags(Block* block)
+{
+    bool live = true;
+    for (size_t i = block->ops.size(); i-- > 0;)
+    {
+        Op& op = block->ops[i];
+        bool flagged = op.kind >= Instructions::ADD_8XY4 && op.kind <= Instructions::SHL_8XYE;
+        if (flagged) flagOps++;
+
+        // Ops naming VF as an operand keep their flag, since the two writes to VF interact
+        if (flagged && !live && op.x != 0xF && op.y != 0xF)
+        {
+            op.kind = ADD_8XY4_NO_VF + (op.kind - Instructions::ADD_8XY4);
+            block->deadFlags = true;
+            flagsRemoved++;
+        }
+
+        if (OverwritesFlag(op)) live = false;
+        if (ReadsFlag(op)) live = true;
+    }
+}
+
+BlockEngine::Block* BlockEngine::Lookup(const Chip8& chip8, uint16_t pc)
+{
+    uint16_t address = pc & 0xFFF;
+    Block* block = blocks[address].get();
+    return block != nullptr ? block : Build(chip8, address);
+}
+
+BlockEngine::Block* BlockEngine::Follow(const Chip8& chip8, Block* from, uint16_t pc)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        const Link& link = from->links[i];
+        if (link.block != nullptr && link.pc == pc && link.epoch == epoch)
+        {
+            chained++;
+            return link.block;
+        }
+    }
+
+    lookedUp++;
+    Block* to = Lookup(chip8, pc);
+    Link& link = from->links[from->nextLink];
+    link.pc = pc;
+    link.epoch = epoch;
+    link.block = to;
+    from->nextLink ^= 1;
+    return to;
+}
+
+// Runs Execute with the machine's quirk profile as its template argument
+struct BlockEngine::Runner
+{
+    BlockEngine* engine;
+    Chip8* chip8;
+    long count;
+
+    template <class Q>
+    void Run(void) { engine->Execute<Q>(*chip8, count); }
+};
+
+void BlockEngine::Run(Chip8& chip8, long count)
+{
+    if (&chip8 != machine)
+    {
+        Flush(chip8);
+        machine = &chip8;
+    }
+
+    // Memory may have been written from outside since the last call
+    Sync(chip8);
+
+    // Blocks do not depend on the profile, only the handlers do
+    Runner runner = {this, &chip8, count};
+    VisitQuirks(chip8.Quirks(), chip8.Bounds(), runner);
+}
+
+template <class Q>
+void BlockEngine::Execute(Chip8& chip8, long count)
+{
+    // pc lives in a local; it is written back around the helpers and Update calls that use it
+    uint8_t* V = Instructions::V(chip8);
+    uint16_t pc = Instructions::PC(chip8);
+    const long budget = count;
+
+    // Where the last FX33 or FX55 stored, since FX55 may move I past it
+    uint16_t stored = 0;
+
+    Block* block = Lookup(chip8, pc);
+    while (count > 0)
+    {
+        long length = (long)block->ops.size();
+        long steps = length < count ? length : count;
+        const Op* op = &block->ops[0];
+
+        // Removed flags rely on a later op in the block overwriting VF, which only holds if the block finishes
+        const bool eager = block->deadFlags && (Q::BOUNDS == BOUNDS_FAULT || steps < length);
+
+        for (long i = 0; i < steps; i++, op++)
+        {
+            uint8_t x = op->x;
+            uint8_t y = op->y;
+            int kind = eager ? EagerKind(op->kind) : op->kind;
+
+            // Update halts the machine on a fault and leaves pc alone from then on, so every later op
+            // in the block comes here too
+            if (Q::BOUNDS == BOUNDS_FAULT && chip8.Check(pc) != Chip8::FAULT_NONE) kind = Instructions::FALLBACK;
+
+            switch (kind)
+            {
+                case Instructions::CLS_00E0: Instructions::Clear(chip8); pc += 2; break;
+                case Instructions::RET_00EE: Instructions::Return(chip8); pc = Instructions::PC(chip8); break;
+                case Instructions::JP_1NNN: pc = op->nnn; break;
+                case Instructions::CALL_2NNN: Instructions::PC(chip8) = pc; Instructions::Call(chip8, op->nnn); pc = op->nnn; break;
+                case Instructions::SE_3XKK: pc += V[x] == op->kk ? 4 : 2; break;
+                case Instructions::SNE_4XKK: pc += V[x] != op->kk ? 4 : 2; break;
+                case Instructions::SE_5XY0: pc += V[x] == V[y] ? 4 : 2; break;
+                case Instructions::LD_6XKK: V[x] = op->kk; pc += 2; break;
+                case Instructions::ADD_7XKK: V[x] += op->kk; pc += 2; break;
+                case Instructions::LD_8XY0: V[x] = V[y]; pc += 2; break;
+                case Instructions::OR_8XY1: V[x] |= V[y]; if (Q::LOGIC_RESETS_VF) V[0xF] = 0; pc += 2; break;
+                case Instructions::AND_8XY2: V[x] &= V[y]; if (Q::LOGIC_RESETS_VF) V[0xF] = 0; pc += 2; break;
+                case Instructions::XOR_8XY3: V[x] ^= V[y]; if (Q::LOGIC_RESETS_VF) V[0xF] = 0; pc += 2; break;
+
+                // VF is written before the result, exactly as Update orders it, so x or y == F behaves the same
+                case Instructions::ADD_8XY4: V[0xF] = (int)V[x] + (int)V[y] < 256 ? 0 : 1; V[x] += V[y]; pc += 2; break;
+                case Instructions::SUB_8XY5: V[0xF] = V[x] < V[y] ? 0 : 1; V[x] -= V[y]; pc += 2; break;
+                case Instructions::SHR_8XY6: V[0xF] = V[Q::SHIFT_READS_VY ? y : x] & 0x1; V[x] = V[Q::SHIFT_READS_VY ? y : x] >> 1; pc += 2; break;
+                case Instructions::SUBN_8XY7: V[0xF] = V[y] < V[x] ? 0 : 1; V[x] = V[y] - V[x]; pc += 2; break;
+                case Instructions::SHL_8XYE: V[0xF] = V[Q::SHIFT_READS_VY ? y : x] >> 7; V[x] = V[Q::SHIFT_READS_VY ? y : x] << 1; pc += 2; break;
+
+                // The same with VF left alone; x and y are never F here
+                case ADD_8XY4_NO_VF: V[x] += V[y]; pc += 2; break;
+                case SUB_8XY5_NO_VF: V[x] -= V[y]; pc += 2; break;
+                case SHR_8XY6_NO_VF: V[x] = V[Q::SHIFT_READS_VY ? y : x] >> 1; pc += 2; break;
+                case SUBN_8XY7_NO_VF: V[x] = V[y] - V[x]; pc += 2; break;
+                case SHL_8XYE_NO_VF: V[x] = V[Q::SHIFT_READS_VY ? y : x] << 1; pc += 2; break;
+
+                case Instructions::SNE_9XY0: pc += V[x] != V[y] ? 4 : 2; break;
+                case Instructions::LD_ANNN: Instructions::I(chip8) = op->nnn; pc += 2; break;
+                case Instructions::JP_BNNN: pc = op->nnn + V[Q::JUMP_USES_VX ? x : 0]; break;
+                case Instructions::RND_CXKK: V[x] = Instructions::Random(chip8) & op->kk; pc += 2; break;
+                case Instructions::DRW_DXYN: Instructions::Draw<Q>(chip8, x, y, op->n); pc += 2; break;
+                case Instructions::SKP_EX9E: pc += Instructions::KeyDown(chip8, x) ? 4 : 2; break;
+                case Instructions::SKNP_EXA1: pc += Instructions::KeyDown(chip8, x) ? 2 : 4; break;
+                case Instructions::LD_FX07: V[x] = Instructions::DelayTimer(chip8); pc += 2; break;
+                case Instructions::LD_FX0A: Instructions::PC(chip8) = pc; Instructions::WaitKey(chip8, x); pc = Instructions::PC(chip8); break;
+                case Instructions::LD_FX15: Instructions::DelayTimer(chip8) = V[x]; pc += 2; break;
+                case Instructions::LD_FX18: Instructions::SoundTimer(chip8) = V[x]; pc += 2; break;
+                case Instructions::ADD_FX1E: Instructions::I(chip8) += V[x]; pc += 2; break;
+                case Instructions::LD_FX29: Instructions::I(chip8) = 5 * V[x]; pc += 2; break;
+                case Instructions::BCD_FX33: stored = Instructions::I(chip8); Instructions::Bcd(chip8, x); pc += 2; break;
+                case Instructions::LD_FX55: stored = Instructions::I(chip8); Instructions::Store<Q>(chip8, x); pc += 2; break;
+                case Instructions::LD_FX65: Instructions::Load<Q>(chip8, x); pc += 2; break;
+
+                // Unknown opcodes and opcodes split across pages; Update ticks the timers itself
+                default:
+                {
+                    Instructions::PC(chip8) = pc;
+                    chip8.Update();
+                    pc = Instructions::PC(chip8);
+                    continue;
+                }
+            }
+
+            Instructions::Tick(chip8);
+        }
+
+        count -= steps;
+        if (count == 0) break;
+
+        // The block that just ran may be gone if it wrote to its own page; it cannot be linked from then
+        bool dropped = false;
+        if (block->writes)
+        {
+            const Op& last = block->ops.back();
+            if (last.kind == Instructions::BCD_FX33) dropped = Stored(chip8, stored, 3);
+            else if (last.kind == Instructions::LD_FX55) dropped = Stored(chip8, stored, last.x + 1);
+            else dropped = Sync(chip8);
+        }
+        block = dropped ? Lookup(chip8, pc) : Follow(chip8, block, pc);
+    }
+
+    Instructions::PC(chip8) = pc;
+    executed += budget;
+}
+
+void BlockEngine::WriteReport(std::ostream& out) const
+{
+    uint64_t exits = chained + lookedUp;
+    out << "  " << built << " blocks built, " << invalidated << " page invalidations\n"
+        << "  " << exits << " block exits, " << chained << " chained ("
+        << std::fixed << std::setprecision(2) << (exits > 0 ? 100.0 * chained / exits : 0.0) << "%), "
+        << (exits > 0 ? (double)executed / exits : 0.0) << " instructions per block\n"
+        << "  " << flagsRemoved << " of " << flagOps << " flag computations removed as dead\n";
+    out.unsetf(std::ios::fixed);
+}
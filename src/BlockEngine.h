@@ -0,0 +1,129 @@
+#pragma once
+
+#include <memory>
+#include <ostream>
+#include <stdint.h>
+#include <vector>
+
+#include "Engine.h"
+#include "Instructions.h"
+
+/*
+ * Basic-block caching engine
+ *
+ * Straight-line runs of code are decoded into blocks of kind/operand records and executed in a
+ * tight loop. A block ends at the first instruction that can change the flow of control (jumps,
+ * calls, returns, skips, FX0A) or write memory (FX33, FX55, anything left to Update), and never
+ * crosses a 256-byte page, so a block belongs to exactly one page.
+ *
+ * Every block remembers the last two blocks it exited to, so hot loops go from block to block
+ * without a table lookup. A link stores the pc it was taken for and is only followed for that
+ * exact pc, which makes it safe for returns and computed jumps as well as static targets.
+ *
+ * The cache is keyed by start address and invalidated a page at a time: every block in the page
+ * is dropped and all links are cut by bumping an epoch they are stamped with. FX33 and FX55 only
+ * invalidate when they overwrite bytes a block was decoded from, since games keep scores and
+ * scratch data next to their code; writes the engine cannot see precisely (Update, or the owner
+ * between calls) invalidate any page holding blocks whose version changed. Blocks may overlap:
+ * running out of budget mid-block leaves pc inside it, and the next call builds a block there.
+ *
+ * Most VF writes by 8xy4/8xy5/8xy6/8xy7/8xyE are overwritten before anything reads them. When a
+ * block is built, a backward pass over it finds those whose VF is overwritten later in the same
+ * block with no read in between, and gives them a kind that skips the flag. VF is taken to be
+ * read at every block exit, so the machine looks the same from outside whenever a block finishes.
+ * Ops naming VF as x or y keep their flag. A block that cannot finish (out of budget, or in
+ * BOUNDS_FAULT mode where any op may halt the machine) runs every flag eagerly instead.
+ */
+class BlockEngine : public Engine
+{
+public:
+    BlockEngine(void);
+
+    void Run(Chip8& chip8, long count);
+    void Reset(void);
+    void WriteReport(std::ostream& out) const;
+
+    uint64_t built;
+    uint64_t invalidated;
+    uint64_t chained;
+    uint64_t lookedUp;
+    uint64_t executed;
+
+    // Flag-setting ops in the blocks built, and how many of those had their flag removed
+    uint64_t flagOps;
+    uint64_t flagsRemoved;
+private:
+    // The flag-setting ALU ops with their VF write removed, numbered after Instructions::Kind
+    enum DeadFlagKind
+    {
+        ADD_8XY4_NO_VF = Instructions::KIND_COUNT,
+        SUB_8XY5_NO_VF,
+        SHR_8XY6_NO_VF,
+        SUBN_8XY7_NO_VF,
+        SHL_8XYE_NO_VF
+    };
+
+    struct Op
+    {
+        uint8_t kind;
+        uint8_t x;
+        uint8_t y;
+        uint8_t n;
+        uint8_t kk;
+        uint16_t nnn;
+    };
+
+    struct Block;
+
+    struct Link
+    {
+        uint16_t pc;
+        uint32_t epoch;
+        Block* block;
+    };
+
+    struct Block
+    {
+        std::vector<Op> ops;
+
+        // Set when the last op may have written memory, so it is checked before moving on
+        bool writes;
+
+        // Set when some op skips its flag, so a block that cannot finish has to run them eagerly
+        bool deadFlags;
+
+        Link links[2];
+        int nextLink;
+    };
+
+    struct Runner;
+
+    // The run loop for one quirk profile
+    template <class Q>
+    void Execute(Chip8& chip8, long count);
+
+    void Flush(const Chip8& chip8);
+
+    void Drop(int page);
+
+    // Both return true if any blocks were dropped, which also cuts every link
+    bool Sync(const Chip8& chip8);
+    bool Stored(const Chip8& chip8, uint16_t address, int count);
+
+    Block* Lookup(const Chip8& chip8, uint16_t pc);
+    Block* Build(const Chip8& chip8, uint16_t address);
+    Block* Follow(const Chip8& chip8, Block* from, uint16_t pc);
+
+    void RemoveDeadFlags(Block* block);
+    static bool ReadsFlag(const Op& op);
+    static bool OverwritesFlag(const Op& op);
+    static int EagerKind(int kind);
+
+    std::unique_ptr<Block> blocks[4096];
+    bool codeBytes[4096];
+    int pageBlocks[Chip8::PAGE_COUNT];
+    uint32_t decodedVersions[Chip8::PAGE_COUNT];
+    uint32_t decodedMemoryVersion;
+    uint32_t epoch;
+    const Chip8* machine;
+};
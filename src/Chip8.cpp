@@ -1,6 +1,30 @@
 #include "Chip8.h"
+#include "Probes.h"
 
+#include <atomic>
 #include <iostream>
+#include <string.h>
+
+// Per-instruction logging is compiled in only when CHIP8_TRACE is defined
+#ifdef CHIP8_TRACE
+#define TRACE(...) printf(__VA_ARGS__)
+#else
+#define TRACE(...)
+#endif
+
+// Profiling hooks only exist in CHIP8_PROFILE builds
+#ifdef CHIP8_PROFILE
+#define PROFILE(call) if (profiler != nullptr) profiler->call
+#else
+#define PROFILE(call)
+#endif
+
+// Memory access tracking only exists in CHIP8_TRACK_MEMORY builds
+#ifdef CHIP8_TRACK_MEMORY
+#define TRACK(access, address) if (tracker != nullptr) tracker->Record(MemoryTracker::access, address)
+#else
+#define TRACK(access, address)
+#endif
 
 unsigned char chip8_fontset[80] =
 {
@@ -24,14 +48,25 @@ unsigned char chip8_fontset[80] =
 
 Chip8::Chip8()
 {
+#ifdef CHIP8_PROFILE
+    profiler = nullptr;
+#endif
+#ifdef CHIP8_TRACK_MEMORY
+    tracker = nullptr;
+#endif
+    quirks = QUIRKS_DEFAULT;
+    bounds = BOUNDS_WRAP;
+    SelectStep();
     Init();
 }
 
 void Chip8::Init()
 {
-    pc = &memory[0x200];
+    pc = 0x200;
     I = 0;
-    sp = stack;
+    sp = 0;
+    fault = FAULT_NONE;
+    drawFlag = false;
 
     for (int i = 0; i < 2048; i++)
     {
@@ -45,13 +80,136 @@ void Chip8::Init()
         registers[i] = 0;
     }
 
+    // Untouched pages all share one zeroed page
+    static const std::shared_ptr<MemoryPage> zeroPage = std::make_shared<MemoryPage>(MemoryPage());
+    for (int i = 0; i < PAGE_COUNT; i++)
+    {
+        pages[i] = zeroPage;
+        pageVersions[i] = 0;
+    }
+    memoryVersion = 0;
+    memoryHash = 0;
+    displayHash = 0;
+
     for (int i = 0; i < 80; i++)
     {
-        memory[i] = chip8_fontset[i];
+        Write(i, chip8_fontset[i]);
     }
 
     delayTimer = 0;
     soundTimer = 0;
+    rngState = 0x2545F491;
+}
+
+Chip8 Chip8::Clone() const
+{
+    Chip8 copy = *this;
+#ifdef CHIP8_PROFILE
+    copy.profiler = nullptr;
+#endif
+#ifdef CHIP8_TRACK_MEMORY
+    copy.tracker = nullptr;
+#endif
+    return copy;
+}
+
+void Chip8::Restore(const Chip8& saved)
+{
+#ifdef CHIP8_PROFILE
+    Profiler* attachedProfiler = profiler;
+#endif
+#ifdef CHIP8_TRACK_MEMORY
+    MemoryTracker* attachedTracker = tracker;
+#endif
+    *this = saved;
+#ifdef CHIP8_PROFILE
+    profiler = attachedProfiler;
+#endif
+#ifdef CHIP8_TRACK_MEMORY
+    tracker = attachedTracker;
+#endif
+}
+
+void Chip8::Write(uint16_t address, uint8_t value)
+{
+    address &= 0xFFF;
+    std::shared_ptr<MemoryPage>& page = pages[address >> 8];
+    uint8_t& byte = page->bytes[address & 0xFF];
+    if (byte == value) return;
+
+    memoryHash ^= MemoryKey(address, byte) ^ MemoryKey(address, value);
+    pageVersions[address >> 8]++;
+    memoryVersion++;
+
+    // A page nobody else holds can be written in place; otherwise this machine takes its own copy.
+    // The last other holder may have been a clone on another thread, so order its reads before the write
+    if (page.use_count() > 1) page = std::make_shared<MemoryPage>(*page);
+    else std::atomic_thread_fence(std::memory_order_acquire);
+    page->bytes[address & 0xFF] = value;
+}
+
+static uint64_t HashBytes(const uint8_t* data, size_t size, uint64_t seed)
+{
+    // FNV-1a over 64-bit words
+    uint64_t hash = seed ^ 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 0x100000001B3ULL;
+    }
+    return hash ^ (hash >> 29);
+}
+
+uint64_t Chip8::StateHash() const
+{
+    return CombineHash(memoryHash, displayHash);
+}
+
+uint64_t Chip8::RecomputeStateHash() const
+{
+    uint64_t memory = 0;
+    for (int address = 0; address < 4096; address++) memory ^= MemoryKey(address, Read(address));
+
+    uint64_t lit = 0;
+    for (int pixel = 0; pixel < 2048; pixel++)
+    {
+        if (display[pixel]) lit ^= PixelKey(pixel);
+    }
+    return CombineHash(memory, lit);
+}
+
+uint64_t Chip8::CombineHash(uint64_t memory, uint64_t lit) const
+{
+    // The CPU state is a few dozen bytes, so it is cheaper to hash here than on every register write
+    uint8_t cpu[16 + 2 * 16 + 8 + 8] = {0};
+    memcpy(cpu, registers, 16);
+    memcpy(cpu + 16, stack, sizeof(stack));
+    cpu[48] = I >> 8;
+    cpu[49] = I & 0xFF;
+    cpu[50] = pc >> 8;
+    cpu[51] = pc & 0xFF;
+    cpu[52] = sp;
+    cpu[53] = delayTimer;
+    cpu[54] = soundTimer;
+    memcpy(cpu + 56, &rngState, sizeof(rngState));
+
+    // The profile, bounds mode and fault change what the machine does next; the defaults leave the hash
+    // as it always was
+    uint64_t profile = quirks != QUIRKS_DEFAULT ? Mix(0x200000 + quirks) : 0;
+    uint64_t checked = bounds != BOUNDS_WRAP ? Mix(0x300000 + bounds) : 0;
+    uint64_t halted = fault != FAULT_NONE ? Mix(0x400000 + fault) : 0;
+
+    return HashBytes(cpu, sizeof(cpu), 0) ^ memory ^ lit ^ profile ^ checked ^ halted;
+}
+
+// xorshift32
+uint8_t Chip8::Random()
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState >> 24;
 }
 
 bool Chip8::LoadRom(const char* path)
@@ -78,24 +236,67 @@ bool Chip8::LoadRom(const char* path)
         return false;
     }
 
+    fclose(rom);
+    if (!CopyRom(romBuffer, (size_t)size)) return false;
+
+    CHIP8_PROBE2(rom_load, path, size);
+    return true;
+}
+
+bool Chip8::LoadRom(const uint8_t* data, size_t size)
+{
+    if (!CopyRom(data, size)) return false;
+
+    CHIP8_PROBE2(rom_load, (const char*)nullptr, size);
+    return true;
+}
+
+bool Chip8::CopyRom(const uint8_t* data, size_t size)
+{
     if (4096-512 < size)
     {
         std::cerr << "ROM is too large" << std::endl;
         return false;
     }
 
-    for (int i = 0; i < size; i++)
+    for (size_t i = 0; i < size; i++)
     {
-        memory[i + 0x200] = romBuffer[i];
+        Write(i + 0x200, data[i]);
     }
 
-    fclose(rom);
     return true;
 }
 
 void Chip8::Update()
 {
-    uint16_t opcode = (*pc << 8) | *(pc + 1);
+    PROFILE(Resume());
+    (this->*step)();
+    PROFILE(Pause());
+}
+
+// The body of Update for one quirk profile; Q's constants are fixed here, so the quirk tests fold away
+template <class Q>
+void Chip8::Step()
+{
+    // Wrapping needs nothing here: Read and Write mask addresses and the stack and keypad are indexed
+    // through masks. Faulting checks the instruction before it runs, then stops for good
+    if (Q::BOUNDS == BOUNDS_FAULT)
+    {
+        if (fault != FAULT_NONE) return;
+
+        fault = Check(pc);
+        if (fault != FAULT_NONE)
+        {
+            std::cerr << "Fault at 0x" << std::hex << pc << std::dec << ": " << FaultName(fault) << std::endl;
+            return;
+        }
+    }
+
+    uint16_t opcode = (Read(pc) << 8) | Read(pc + 1);
+    CHIP8_PROBE2(instruction, pc, opcode);
+    PROFILE(Instruction(pc, opcode));
+    TRACK(EXECUTE, pc);
+    TRACK(EXECUTE, pc + 1);
 
     switch ((opcode & 0xF000) >> 12)
     {
@@ -107,17 +308,19 @@ void Chip8::Update()
                 case 0xE0:
                 {
                     for (int i = 0; i < 2048; i++) display[i] = 0;
+                    displayHash = 0;
                     drawFlag = true;
                     pc += 2;
-                    printf("0x%X: Clearing the screen\n");
+                    TRACE("0x%X: Clearing the screen\n");
                     break;
                 }
 
                 // 00EE: Return pc to the value at the top of the stack; decrement sp
                 case 0xEE:
                 {
-                    pc = *(--sp);
-                    printf("0x%X: Returning to %x from subroutine\n", opcode, pc - memory);
+                    pc = stack[--sp & 0xF];
+                    PROFILE(Return());
+                    TRACE("0x%X: Returning to %x from subroutine\n", opcode, pc);
                     pc += 2;
                     break;
                 }
@@ -137,8 +340,8 @@ void Chip8::Update()
         case 0x1:
         {
             uint16_t val = opcode & 0xFFF;
-            pc = memory + val;
-            printf("0x%X: Setting pc to %X\n", pc - memory);
+            pc = val;
+            TRACE("0x%X: Setting pc to %X\n", pc);
             break;
         }
 
@@ -150,10 +353,11 @@ void Chip8::Update()
         case 0x2:
         {
             uint16_t val = opcode & 0xFFF;
-            *sp = pc;
+            stack[sp & 0xF] = pc;
             sp++;
-            pc = memory + val;
-            printf("0x%X: Going to subroutine at 0x%X, 0x%X on stack\n", opcode, pc - memory, *(sp - 1));
+            pc = val;
+            PROFILE(Call(val));
+            TRACE("0x%X: Going to subroutine at 0x%X, 0x%X on stack\n", opcode, pc, stack[(sp - 1) & 0xF]);
             break;
         }
 
@@ -165,10 +369,10 @@ void Chip8::Update()
             if (registers[x] == val)
             {
                 pc += 4;
-                printf("0x%X: Skipping next instruction; V[%X] == %X\n", opcode, x, val);
+                TRACE("0x%X: Skipping next instruction; V[%X] == %X\n", opcode, x, val);
             } else {
                 pc += 2;
-                printf("0x%X: Not skipping next instruction; V[%X] != %X\n", opcode, x, val);
+                TRACE("0x%X: Not skipping next instruction; V[%X] != %X\n", opcode, x, val);
             }
             break;
         }
@@ -182,10 +386,10 @@ void Chip8::Update()
             if (registers[x] != val)
             {
                 pc += 4;
-                printf("0x%X: Skipping next instruction; V[%X] != %X\n", opcode, x, val);
+                TRACE("0x%X: Skipping next instruction; V[%X] != %X\n", opcode, x, val);
             } else {
                 pc += 2;
-                printf("0x%X: Not skipping next instruction; V[%X] == %X\n", opcode, x, val);
+                TRACE("0x%X: Not skipping next instruction; V[%X] == %X\n", opcode, x, val);
             }
             break;
         }
@@ -198,10 +402,10 @@ void Chip8::Update()
             if (registers[x] == registers[y])
             {
                 pc += 4;
-                printf("0x%X: Skipping next instruction; V[%X] == V[%X]", opcode, x, y);
+                TRACE("0x%X: Skipping next instruction; V[%X] == V[%X]", opcode, x, y);
             } else {
                 pc += 2;
-                printf("0x%X: Not skipping next instruction; V[%X] != V[%X]", opcode, x, y);
+                TRACE("0x%X: Not skipping next instruction; V[%X] != V[%X]", opcode, x, y);
             }
             break;
         }
@@ -212,7 +416,7 @@ void Chip8::Update()
             uint8_t x = (opcode & 0x0F00) >> 8;
             uint8_t val = opcode & 0xFF;
             registers[x] = val;
-            printf("0x%X: Setting V[%X] to %X\n", opcode, x, val);
+            TRACE("0x%X: Setting V[%X] to %X\n", opcode, x, val);
             pc += 2;
             break;
         }
@@ -223,7 +427,7 @@ void Chip8::Update()
             uint8_t x = (opcode & 0xF00) >> 8;
             uint8_t val = opcode & 0xFF;
             registers[x] += val;
-            printf("0x%X: Incrementing V[%X] by %X\n", opcode, x, val);
+            TRACE("0x%X: Incrementing V[%X] by %X\n", opcode, x, val);
             pc += 2;
             break;
         }
@@ -238,7 +442,7 @@ void Chip8::Update()
                     uint8_t x = (opcode & 0xF00) >> 8;
                     uint8_t y = (opcode & 0xF0) >> 4;
                     registers[x] = registers[y];
-                    printf("0x%X: V[%X] = V[%X]\n", opcode, x, y);
+                    TRACE("0x%X: V[%X] = V[%X]\n", opcode, x, y);
                     pc += 2;
                     break;
                 }
@@ -249,8 +453,9 @@ void Chip8::Update()
                     uint8_t x = (opcode & 0xF00) >> 8;
                     uint8_t y = (opcode & 0xF0) >> 4;
                     registers[x] |= registers[y];
+                    if (Q::LOGIC_RESETS_VF) registers[0xF] = 0;
                     pc += 2;
-                    printf("0x%X: V[%X] |= V[%X]; V[%X] = %X\n", opcode, x, y, x, registers[x]);
+                    TRACE("0x%X: V[%X] |= V[%X]; V[%X] = %X\n", opcode, x, y, x, registers[x]);
                     break;
                 }
 
@@ -260,7 +465,8 @@ void Chip8::Update()
                     uint8_t x = (opcode & 0xF00) >> 8;
                     uint8_t y = (opcode & 0xF0) >> 4;
                     registers[x] = registers[x] & registers[y];
-                    printf("0x%X: V[%X] &= V[%X]; V[%X] = %X\n", opcode, x, y, x, registers[x]);
+                    if (Q::LOGIC_RESETS_VF) registers[0xF] = 0;
+                    TRACE("0x%X: V[%X] &= V[%X]; V[%X] = %X\n", opcode, x, y, x, registers[x]);
                     pc += 2;
                     break;
                 }
@@ -271,7 +477,8 @@ void Chip8::Update()
                     uint8_t x = (opcode & 0xF00) >> 8;
                     uint8_t y = (opcode & 0xF0) >> 4;
                     registers[x] ^= registers[y];
-                    printf("0x%X: V[%X] ^= V[%X]; V[%X] = %X\n", opcode, x, y, x, registers[x]);
+                    if (Q::LOGIC_RESETS_VF) registers[0xF] = 0;
+                    TRACE("0x%X: V[%X] ^= V[%X]; V[%X] = %X\n", opcode, x, y, x, registers[x]);
                     pc += 2;
                     break;
                 }
@@ -287,7 +494,7 @@ void Chip8::Update()
                     else registers[0xF] = 1;
                     registers[x] += registers[y];
                     pc += 2;
-                    printf("0x%X: V[%X] += V[%X]; V[%X] = %X\n", opcode, x, y, x, registers[x]);
+                    TRACE("0x%X: V[%X] += V[%X]; V[%X] = %X\n", opcode, x, y, x, registers[x]);
                     break;
                 }
 
@@ -302,18 +509,20 @@ void Chip8::Update()
                     registers[x] -= registers[y];
 
                     pc += 2;
-                    printf("0x%X: V[%X] -= V[%X]; V[%X] = %X\n", opcode, x, y, x, registers[x]);
+                    TRACE("0x%X: V[%X] -= V[%X]; V[%X] = %X\n", opcode, x, y, x, registers[x]);
                     break;
                 }
 
-                // 8X_6: Shifts VX right by one. VF is set to the value of the least significant bit of VX before the shift
+                // 8XY6: Shifts VX right by one. VF is set to the value of the least significant bit of VX before the shift
+                // Profiles with SHIFT_READS_VY shift VY into VX instead
                 case 0x6:
                 {
                     uint8_t x = (opcode & 0xF00) >> 8;
-                    registers[0xF] = registers[x] & 0x1;
-                    registers[x] = registers[x] >> 1;
+                    uint8_t src = Q::SHIFT_READS_VY ? (opcode & 0xF0) >> 4 : x;
+                    registers[0xF] = registers[src] & 0x1;
+                    registers[x] = registers[src] >> 1;
                     pc += 2;
-                    printf("0x%X: Right shift V[%X] by one; V[F] = %X, V[%X] = %X\n", opcode, x, registers[0xF], x, registers[x]);
+                    TRACE("0x%X: Right shift V[%X] by one; V[F] = %X, V[%X] = %X\n", opcode, x, registers[0xF], x, registers[x]);
                     break;
                 }
 
@@ -328,18 +537,20 @@ void Chip8::Update()
                     registers[x] = registers[y] - registers[x];
 
                     pc += 2;
-                    printf("0x%X: V[%X] = V[%X] - V[%X]; V[%X] = %X\n", opcode, x, y, x, x, registers[x]);
+                    TRACE("0x%X: V[%X] = V[%X] - V[%X]; V[%X] = %X\n", opcode, x, y, x, x, registers[x]);
                     break;
                 }
 
-                // 8X_E: Shifts VX left by one. VF is set to the value of the most significant bit of VX before the shift
+                // 8XYE: Shifts VX left by one. VF is set to the value of the most significant bit of VX before the shift
+                // Profiles with SHIFT_READS_VY shift VY into VX instead
                 case 0xE:
                 {
                     uint8_t x = (opcode & 0xF00) >> 8;
-                    registers[0xF] = registers[x] >> 7;
-                    registers[x] = registers[x] << 1;
+                    uint8_t src = Q::SHIFT_READS_VY ? (opcode & 0xF0) >> 4 : x;
+                    registers[0xF] = registers[src] >> 7;
+                    registers[x] = registers[src] << 1;
                     pc += 2;
-                    printf("0x%X: Right shift V[%X] by one; V[F] = %X, V[%X] = %X\n", opcode, x, registers[0xF], x, registers[x]);
+                    TRACE("0x%X: Right shift V[%X] by one; V[F] = %X, V[%X] = %X\n", opcode, x, registers[0xF], x, registers[x]);
                     break;
                 }
 
@@ -363,10 +574,10 @@ void Chip8::Update()
             if (registers[x] != registers[y])
             {
                 pc += 4;
-                printf("0x%X: Skipping next instruction; V[%X] != V[%X]\n", opcode, x, y);
+                TRACE("0x%X: Skipping next instruction; V[%X] != V[%X]\n", opcode, x, y);
             } else {
                 pc += 2;
-                printf("0x%X: Not skipping next instruction; V[%X] != V[%X]\n", opcode, x, y);
+                TRACE("0x%X: Not skipping next instruction; V[%X] != V[%X]\n", opcode, x, y);
             }
             break;
         }
@@ -376,17 +587,17 @@ void Chip8::Update()
         {
             uint16_t val = opcode & 0xFFF;
             I = val;
-            printf("0x%X: Setting I to %X\n", opcode, val);
+            TRACE("0x%X: Setting I to %X\n", opcode, val);
             pc += 2;
             break;
         }
 
-        //Bnnn: Sets pc to nnn + V0
+        //Bnnn: Sets pc to nnn + V0, or to nnn + Vx on profiles with JUMP_USES_VX
         case 0xB:
         {
             uint16_t val = opcode & 0xFFF;
-            pc = &memory[val + registers[0]];
-            printf("0x%X: Setting pc to %X", pc - memory);
+            pc = val + registers[Q::JUMP_USES_VX ? (opcode & 0xF00) >> 8 : 0];
+            TRACE("0x%X: Setting pc to %X", pc);
             break;
         }
 
@@ -395,8 +606,8 @@ void Chip8::Update()
         {
             uint8_t x = (opcode & 0xF00) >> 8;
             uint8_t val = opcode & 0xFF;
-            registers[x] = (rand() % (0xFF + 1)) & val;
-            printf("0x%X: Setting V[%X] to a random byte anded with %X; val = %X\n", opcode, x, val, registers[x]);
+            registers[x] = Random() & val;
+            TRACE("0x%X: Setting V[%X] to a random byte anded with %X; val = %X\n", opcode, x, val, registers[x]);
             pc += 2;
             break;
         }
@@ -420,26 +631,42 @@ void Chip8::Update()
             uint8_t yPos = registers[y];
             uint8_t lineSprite;
 
+            // Clipping profiles wrap the starting position only and cut the sprite off at the edges
+            if (Q::SPRITES_CLIP)
+            {
+                xPos %= 64;
+                yPos %= 32;
+            }
+
             registers[0xF] = 0;
             for (uint8_t yLine = 0; yLine < n; yLine++)
             {
-                lineSprite = memory[I + yLine];
+                if (Q::SPRITES_CLIP && yPos + yLine >= 32) break;
+
+                lineSprite = Read(I + yLine);
+                TRACK(READ, I + yLine);
                 for (uint8_t xLine = 0; xLine < 8; xLine++)
                 {
+                    if (Q::SPRITES_CLIP && xPos + xLine >= 64) break;
+
                     if ((lineSprite & (0x80 >> xLine)) != 0)
                     {
-                        if (display[((yPos + yLine) * 64) + (xPos + xLine)] == 1)
+                        // Sprites wrap around the edges of the screen
+                        int pixel = (((yPos + yLine) % 32) * 64) + ((xPos + xLine) % 64);
+                        if (display[pixel] == 1)
                         {
                             registers[0xF] = 1;
                         }
 
-                        display[((yPos + yLine) * 64) + (xPos + xLine)] ^= 1;
+                        display[pixel] ^= 1;
+                        displayHash ^= PixelKey(pixel);
                     }
                 }
             }
             drawFlag = true;
             pc += 2;
-            printf("0x%X: Drawing sprite at (%u, %u) from I\n", opcode, xPos, yPos);
+            CHIP8_PROBE4(draw, xPos, yPos, n, registers[0xF]);
+            TRACE("0x%X: Drawing sprite at (%u, %u) from I\n", opcode, xPos, yPos);
             break;
         }
 
@@ -452,13 +679,13 @@ void Chip8::Update()
                 {
                     uint8_t x = (opcode & 0x0F00) >> 8;
 
-                    if (key[registers[x]] != 1)
+                    if (key[registers[x] & 0xF] != 1)
                     {
                         pc += 2;
-                        printf("0x%X: Not skipping next instruction; %X was not pressed\n", opcode, x, registers[x]);
+                        TRACE("0x%X: Not skipping next instruction; %X was not pressed\n", opcode, x, registers[x]);
                     } else {
                         pc += 4;
-                        printf("0x%X: Skipping next instruction; %X was pressed\n", opcode, x, registers[x]);
+                        TRACE("0x%X: Skipping next instruction; %X was pressed\n", opcode, x, registers[x]);
                     }
                     break;
                 }
@@ -468,13 +695,13 @@ void Chip8::Update()
                 {
                     uint8_t x = (opcode & 0x0F00) >> 8;
 
-                    if (key[registers[x]] != 1)
+                    if (key[registers[x] & 0xF] != 1)
                     {
                         pc += 4;
-                        printf("0x%X: Skipping next instruction; %X was not pressed\n", opcode, x, registers[x]);
+                        TRACE("0x%X: Skipping next instruction; %X was not pressed\n", opcode, x, registers[x]);
                     } else {
                         pc += 2;
-                        printf("0x%X: Not skipping next instruction; %X was pressed\n", opcode, x, registers[x]);
+                        TRACE("0x%X: Not skipping next instruction; %X was pressed\n", opcode, x, registers[x]);
                     }
                     break;
                 }
@@ -499,7 +726,7 @@ void Chip8::Update()
                 {
                     uint8_t x = (opcode & 0xF00) >> 8;
                     registers[x] = delayTimer;
-                    printf("0x%X: Setting V[%X] to delay timer = %X\n", opcode, x, delayTimer);
+                    TRACE("0x%X: Setting V[%X] to delay timer = %X\n", opcode, x, delayTimer);
                     pc += 2;
                     break;
                 }
@@ -524,7 +751,7 @@ void Chip8::Update()
                 {
                     uint8_t x = (opcode & 0xF00) >> 8;
                     delayTimer = registers[x];
-                    printf("0x%X: Setting delay timer to V[%X] = %X\n", opcode, x, delayTimer);
+                    TRACE("0x%X: Setting delay timer to V[%X] = %X\n", opcode, x, delayTimer);
                     pc += 2;
                     break;
                 }
@@ -534,7 +761,7 @@ void Chip8::Update()
                 {
                     uint8_t x = (opcode & 0xF00) >> 8;
                     soundTimer = registers[x];
-                    printf("0x%X: Setting sound timer to V[%X] = %X\n", opcode, x, delayTimer);
+                    TRACE("0x%X: Setting sound timer to V[%X] = %X\n", opcode, x, delayTimer);
                     pc += 2;
                     break;
                 }
@@ -544,7 +771,7 @@ void Chip8::Update()
                 {
                     uint8_t x = (opcode & 0xF00) >> 8;
                     I += registers[x];
-                    printf("0x%X: I+= V[%X]; I = %X", opcode, x, I);
+                    TRACE("0x%X: I+= V[%X]; I = %X", opcode, x, I);
                     pc += 2;
                     break;
                 }
@@ -556,7 +783,7 @@ void Chip8::Update()
                     uint8_t val = registers[x];
                     I = 5 * val;
                     pc += 2;
-                    printf("0x%X: Setting I to the location of %X; I = %X\n", opcode, val, I);
+                    TRACE("0x%X: Setting I to the location of %X; I = %X\n", opcode, val, I);
                     break;
                 }
 
@@ -570,10 +797,13 @@ void Chip8::Update()
                     uint16_t tens = (val - hundreds - ((val - hundreds) % 10));
                     uint16_t ones = val - hundreds - tens;
 
-                    memory[I] = hundreds / 100;
-                    memory[I+1] = tens / 10;
-                    memory[I+2] = ones;
-                    printf("0x%X: Storing bcd of %u at I [hundreds:%u, tens:%u, ones:%u]\n", opcode, val, hundreds / 100, tens / 10, ones);
+                    Write(I, hundreds / 100);
+                    Write(I+1, tens / 10);
+                    Write(I+2, ones);
+                    TRACK(WRITE, I);
+                    TRACK(WRITE, I + 1);
+                    TRACK(WRITE, I + 2);
+                    TRACE("0x%X: Storing bcd of %u at I [hundreds:%u, tens:%u, ones:%u]\n", opcode, val, hundreds / 100, tens / 10, ones);
                     pc += 2;
                     break;
                 }
@@ -583,9 +813,14 @@ void Chip8::Update()
                 {
                     uint8_t x = (opcode & 0xF00) >> 8;
 
-                    for (int i = 0; i <= x; i++) memory[I + i] = registers[i];
+                    for (int i = 0; i <= x; i++)
+                    {
+                        Write(I + i, registers[i]);
+                        TRACK(WRITE, I + i);
+                    }
+                    I += IndexStep<Q>(x);
                     pc += 2;
-                    printf("0x%X: Writing to memory at I from V[0-%X]\n", opcode, x);
+                    TRACE("0x%X: Writing to memory at I from V[0-%X]\n", opcode, x);
                     break;
                 }
 
@@ -593,8 +828,13 @@ void Chip8::Update()
                 case 0x65:
                 {
                     uint8_t x = (opcode & 0xF00) >> 8;
-                    for (int i = 0; i <= x; i++) registers[i] = memory[I + i];
-                    printf("0x%X: Writing to registers 0 through %X from I\n", opcode, x);
+                    for (int i = 0; i <= x; i++)
+                    {
+                        registers[i] = Read(I + i);
+                        TRACK(READ, I + i);
+                    }
+                    I += IndexStep<Q>(x);
+                    TRACE("0x%X: Writing to registers 0 through %X from I\n", opcode, x);
                     pc += 2;
                     break;
                 }
@@ -616,6 +856,104 @@ void Chip8::Update()
         }
     }
 
-    if (delayTimer > 0) delayTimer--;
-    if (soundTimer > 0) soundTimer--;
+    if (delayTimer > 0 || soundTimer > 0)
+    {
+        if (delayTimer > 0) delayTimer--;
+        if (soundTimer > 0) soundTimer--;
+        CHIP8_PROBE2(timer_tick, delayTimer, soundTimer);
+    }
+}
+
+Chip8::Fault Chip8::Check(uint16_t address) const
+{
+    if (address > 0xFFE) return FAULT_FETCH;
+
+    uint16_t opcode = (Read(address) << 8) | Read(address + 1);
+    uint8_t x = (opcode & 0xF00) >> 8;
+
+    // Only the opcodes Update runs can fault; unknown ones do nothing
+    switch (opcode >> 12)
+    {
+        case 0x0: return (opcode & 0xFF) == 0xEE && sp == 0 ? FAULT_STACK_UNDERFLOW : FAULT_NONE;
+        case 0x2: return sp >= 16 ? FAULT_STACK_OVERFLOW : FAULT_NONE;
+        case 0xD: return I + (opcode & 0xF) > 0x1000 ? FAULT_MEMORY : FAULT_NONE;
+        case 0xE:
+        {
+            bool keyed = (opcode & 0xFF) == 0x9E || (opcode & 0xFF) == 0xA1;
+            return keyed && registers[x] > 0xF ? FAULT_KEY : FAULT_NONE;
+        }
+        case 0xF:
+        {
+            switch (opcode & 0xFF)
+            {
+                case 0x33: return I + 3 > 0x1000 ? FAULT_MEMORY : FAULT_NONE;
+                case 0x55:
+                case 0x65: return I + x + 1 > 0x1000 ? FAULT_MEMORY : FAULT_NONE;
+                default: return FAULT_NONE;
+            }
+        }
+        default: return FAULT_NONE;
+    }
+}
+
+const char* Chip8::FaultName(Fault fault)
+{
+    switch (fault)
+    {
+        case FAULT_NONE: return "none";
+        case FAULT_FETCH: return "instruction fetch past the end of memory";
+        case FAULT_MEMORY: return "memory access past the end of memory";
+        case FAULT_STACK_OVERFLOW: return "call with the stack full";
+        case FAULT_STACK_UNDERFLOW: return "return with the stack empty";
+        case FAULT_KEY: return "key index above 0xF";
+        default: return "unknown";
+    }
+}
+
+// Picks the Step instantiation for the profile and bounds mode
+struct Chip8::StepSelector
+{
+    Chip8* chip8;
+
+    template <class Q>
+    void Run(void) { chip8->step = &Chip8::Step<Q>; }
+};
+
+void Chip8::SelectStep()
+{
+    StepSelector selector = {this};
+    VisitQuirks(quirks, bounds, selector);
+}
+
+void Chip8::SetQuirks(QuirkProfile profile)
+{
+    quirks = profile;
+    SelectStep();
+}
+
+void Chip8::SetBounds(BoundsMode mode)
+{
+    bounds = mode;
+    SelectStep();
+}
+
+// Runs a frame with the profile's Step called directly, so it can be inlined into the loop
+struct Chip8::FrameRunner
+{
+    Chip8* chip8;
+
+    template <class Q>
+    void Run(void)
+    {
+        for (int i = 0; i < CYCLES_PER_FRAME; i++) chip8->Step<Q>();
+    }
+};
+
+void Chip8::RunFrame()
+{
+    PROFILE(Resume());
+    FrameRunner runner = {this};
+    VisitQuirks(quirks, bounds, runner);
+    PROFILE(Pause());
+    CHIP8_PROBE0(frame);
 }
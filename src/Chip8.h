@@ -1,28 +1,175 @@
 #pragma once
 
+#include <memory>
 #include <string>
 #include <stdint.h>
 
+#include "Quirks.h"
+
+#ifdef CHIP8_PROFILE
+#include "Profiler.h"
+#endif
+
+#ifdef CHIP8_TRACK_MEMORY
+#include "MemoryTracker.h"
+#endif
+
 class Chip8
 {
+    // Shared instruction semantics for the execution engines in Engine.h
+    friend class Instructions;
 public:
+    // Update() runs one instruction; the frontend paces itself at roughly 1.2ms per instruction
+    static const int CYCLES_PER_FRAME = 14;
+
     Chip8(void);
     void Init(void);
     void Update(void);
+    void RunFrame(void);
     bool LoadRom(const char* path);
+    bool LoadRom(const uint8_t* data, size_t size);
+
+    // Selects which variant's behaviour Update follows; kept across Init and LoadRom
+    void SetQuirks(QuirkProfile profile);
+    QuirkProfile Quirks(void) const { return quirks; }
+
+    // Selects what out-of-range accesses do (see Quirks.h); kept across Init and LoadRom
+    void SetBounds(BoundsMode mode);
+    BoundsMode Bounds(void) const { return bounds; }
+
+    enum Fault
+    {
+        FAULT_NONE,
+        FAULT_FETCH,
+        FAULT_MEMORY,
+        FAULT_STACK_OVERFLOW,
+        FAULT_STACK_UNDERFLOW,
+        FAULT_KEY
+    };
+
+    // In BOUNDS_FAULT mode, why the machine halted; it stays halted until Init
+    Fault CurrentFault(void) const { return fault; }
+
+    // The fault the instruction at `address` would raise in BOUNDS_FAULT mode, given the current state
+    Fault Check(uint16_t address) const;
+
+    static const char* FaultName(Fault fault);
+
+    // Copies share memory pages until one side writes to them, so branching a machine is cheap. A
+    // clone has no profiler or memory tracker attached, so speculative and replayed frames are not counted
+    Chip8 Clone(void) const;
+
+    // Takes on the state of `saved`, usually a clone of this machine, keeping what is attached here
+    void Restore(const Chip8& saved);
+
+    uint8_t Read(uint16_t address) const { return pages[(address >> 8) & 0xF]->bytes[address & 0xFF]; }
+    void Write(uint16_t address, uint8_t value);
+
+    uint8_t Register(int index) const { return registers[index & 0xF]; }
+    uint16_t IndexRegister(void) const { return I; }
+    uint16_t ProgramCounter(void) const { return pc; }
+    uint8_t StackPointer(void) const { return sp; }
+    uint16_t StackEntry(int index) const { return stack[index & 0xF]; }
+    uint8_t DelayTimer(void) const { return delayTimer; }
+    uint8_t SoundTimer(void) const { return soundTimer; }
+    uint64_t MemoryHash(void) const { return memoryHash; }
+    uint64_t DisplayHash(void) const { return displayHash; }
+
+    // Bumped whenever a byte in the page changes, so engines can tell when code they decoded is stale
+    uint32_t PageVersion(int page) const { return pageVersions[page & 0xF]; }
+
+    // Bumped with every page version, so one comparison tells whether any page changed
+    uint32_t MemoryVersion(void) const { return memoryVersion; }
+
+    // Hash of everything that determines future behaviour except the keypad. The memory and display
+    // parts are kept up to date as they change, so this costs the same whatever the machine did
+    uint64_t StateHash(void) const;
+
+    // StateHash with the memory and display parts computed from scratch, for checking the incremental ones
+    uint64_t RecomputeStateHash(void) const;
+
+#ifdef CHIP8_PROFILE
+    // Clones start without one; attach a profiler to profile a clone on its own
+    void AttachProfiler(Profiler* attached) { profiler = attached; }
+#endif
+
+#ifdef CHIP8_TRACK_MEMORY
+    // Clones start without one, as with the profiler
+    void AttachMemoryTracker(MemoryTracker* attached) { tracker = attached; }
+#endif
 
     bool drawFlag;
     uint8_t display[2048];
     uint8_t key[16];
+
+    static const int PAGE_SIZE = 256;
+    static const int PAGE_COUNT = 16;
 private:
-    uint8_t memory[4096];
+    struct MemoryPage
+    {
+        uint8_t bytes[PAGE_SIZE];
+    };
+
+    // The 4KB address space as copy-on-write pages; the display and registers are copied eagerly
+    std::shared_ptr<MemoryPage> pages[PAGE_COUNT];
+    uint32_t pageVersions[PAGE_COUNT];
+    uint32_t memoryVersion;
+
+    // XOR of a contribution from every non-zero memory byte and every lit pixel; Write and the
+    // instructions that touch the display update them in place
+    uint64_t memoryHash;
+    uint64_t displayHash;
+
+    // splitmix64 finalizer; gives every (address, value) and pixel its own hash contribution
+    static uint64_t Mix(uint64_t key)
+    {
+        key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        key = (key ^ (key >> 27)) * 0x94D049BB133111EBULL;
+        return key ^ (key >> 31);
+    }
+
+    static uint64_t MemoryKey(uint16_t address, uint8_t value) { return value != 0 ? Mix(((uint64_t)address << 8) | value) : 0; }
+    static uint64_t PixelKey(int pixel) { return Mix(0x100000 + pixel); }
+
+    // StateHash given the memory and display hashes
+    uint64_t CombineHash(uint64_t memory, uint64_t lit) const;
+
     uint8_t registers[16];
-    uint8_t* stack[16];
+
+    // pc, sp and the stack hold offsets rather than pointers so a Chip8 can be copied safely
+    uint16_t stack[16];
 
     uint16_t I;
-    uint8_t *pc;
-    uint8_t **sp;
+    uint16_t pc;
+    uint8_t sp;
 
     uint8_t soundTimer;
     uint8_t delayTimer;
-};
\ No newline at end of file
+
+    // Cxkk draws from per-instance state so copies of a machine replay identically on any thread
+    uint32_t rngState;
+    uint8_t Random(void);
+
+    bool CopyRom(const uint8_t* data, size_t size);
+
+    // Update for one quirk profile; SetQuirks points step at the right instance
+    template <class Q>
+    void Step(void);
+
+    struct StepSelector;
+    struct FrameRunner;
+    void SelectStep(void);
+
+    QuirkProfile quirks;
+    BoundsMode bounds;
+    Fault fault;
+    void (Chip8::*step)(void);
+
+#ifdef CHIP8_PROFILE
+    Profiler* profiler;
+#endif
+
+#ifdef CHIP8_TRACK_MEMORY
+    MemoryTracker* tracker;
+#endif
+};
@@ -0,0 +1,43 @@
+#include "Engine.h"
+#include "BlockEngine.h"
+#include "PredecodeEngine.h"
+#include "RecompiledEngine.h"
+#include "ThreadedEngine.h"
+
+#ifdef CHIP8_SPECIALIZED_ENGINE
+#include "SpecializedEngine.h"
+#endif
+
+template <class T>
+static std::unique_ptr<Engine> Make()
+{
+    return std::unique_ptr<Engine>(new T());
+}
+
+const std::vector<Engine::Info>& Engine::All()
+{
+    // Listed by hand rather than self-registered: static initializers in a static library are
+    // dropped when nothing references their object file
+    static const Info engines[] = {
+        {"reference", "switch interpreter in Chip8::Update", &Make<ReferenceEngine>},
+        {"predecode", "per-address decode cache with profile-selected superinstructions", &Make<PredecodeEngine>},
+        {"block", "basic-block cache with chained block exits", &Make<BlockEngine>},
+        {"threaded", "direct-threaded dispatch with computed goto, or a switch where unsupported", &Make<ThreadedEngine>},
+#ifdef CHIP8_SPECIALIZED_ENGINE
+        {"specialized", "handlers specialized per kind and register pair from a 65536-entry table", &Make<SpecializedEngine>},
+#endif
+        {"recompiled", "ROMs translated to C++ ahead of time where linked in, Update elsewhere", &Make<RecompiledEngine>},
+    };
+    static const std::vector<Info> all(engines, engines + sizeof(engines) / sizeof(engines[0]));
+    return all;
+}
+
+std::unique_ptr<Engine> Engine::Create(const std::string& name)
+{
+    const std::vector<Info>& all = All();
+    for (size_t i = 0; i < all.size(); i++)
+    {
+        if (name == all[i].name) return all[i].create();
+    }
+    return std::unique_ptr<Engine>();
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Chip8.h"
+
+/*
+ * Execution engines
+ *
+ * An engine executes instructions on a Chip8 with exactly the semantics of calling Chip8::Update
+ * that many times: same results, same timer ticks, same point at which key changes are seen.
+ * ReferenceEngine is Update itself; every faster engine is checked against it with chip8_diff.
+ *
+ * Engines may keep decoded code between calls, so an instance belongs to one machine. Call
+ * Reset() after assigning a different state to that machine.
+ */
+class Engine
+{
+public:
+    typedef std::unique_ptr<Engine> (*Factory)(void);
+
+    struct Info
+    {
+        const char* name;
+        const char* description;
+        Factory create;
+    };
+
+    virtual ~Engine(void) {}
+
+    // Runs exactly `count` instructions
+    virtual void Run(Chip8& chip8, long count) = 0;
+
+    // Drops anything cached about the machine, for when its state was replaced from outside
+    virtual void Reset(void) {}
+
+    // Engine-specific statistics for the benchmarks, if the engine keeps any
+    virtual void WriteReport(std::ostream& out) const { (void)out; }
+
+    // Every engine built into this binary, the reference first
+    static const std::vector<Info>& All(void);
+
+    // Returns nullptr for an unknown name
+    static std::unique_ptr<Engine> Create(const std::string& name);
+};
+
+class ReferenceEngine : public Engine
+{
+public:
+    void Run(Chip8& chip8, long count)
+    {
+        for (long i = 0; i < count; i++) chip8.Update();
+    }
+};
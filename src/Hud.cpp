@@ -0,0 +1,128 @@
+#include "Hud.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const uint32_t BACKGROUND = 0xB0000000;
+static const uint32_t TEXT = 0xFFFFFFFF;
+static const uint32_t BAR = 0xFF40C040;
+static const uint32_t SLOW_BAR = 0xFFE04040;
+static const uint32_t TARGET_LINE = 0xFF808080;
+
+// Graph scale: the full height is 50ms, and bars past the 60Hz budget are drawn in red
+static const uint64_t GRAPH_NS = 50000000;
+static const uint64_t BUDGET_NS = 16800000;
+
+/*
+ * 3x5 glyphs, one row per entry with the leftmost pixel in bit 2, for ' ', '%', '.', '0'-'9'
+ * and 'A'-'Z'. Anything else draws as a blank.
+ */
+static const uint8_t glyphs[39][5] = {
+    {0, 0, 0, 0, 0}, {5, 1, 2, 4, 5}, {0, 0, 0, 0, 2},
+    {7, 5, 5, 5, 7}, {2, 6, 2, 2, 7}, {7, 1, 7, 4, 7}, {7, 1, 7, 1, 7}, {5, 5, 7, 1, 1},
+    {7, 4, 7, 1, 7}, {7, 4, 7, 5, 7}, {7, 1, 1, 1, 1}, {7, 5, 7, 5, 7}, {7, 5, 7, 1, 7},
+    {2, 5, 7, 5, 5}, {6, 5, 6, 5, 6}, {3, 4, 4, 4, 3}, {6, 5, 5, 5, 6}, {7, 4, 6, 4, 7},
+    {7, 4, 6, 4, 4}, {3, 4, 5, 5, 3}, {5, 5, 7, 5, 5}, {7, 2, 2, 2, 7}, {1, 1, 1, 5, 2},
+    {5, 5, 6, 5, 5}, {4, 4, 4, 4, 7}, {5, 7, 7, 5, 5}, {6, 5, 5, 5, 5}, {2, 5, 5, 5, 2},
+    {6, 5, 6, 4, 4}, {2, 5, 5, 6, 3}, {6, 5, 6, 5, 5}, {3, 4, 2, 1, 6}, {7, 2, 2, 2, 2},
+    {5, 5, 5, 5, 7}, {5, 5, 5, 5, 2}, {5, 5, 7, 7, 5}, {5, 5, 2, 5, 5}, {5, 5, 2, 2, 2},
+    {7, 1, 2, 4, 7},
+};
+
+static int GlyphIndex(char c)
+{
+    if (c >= '0' && c <= '9') return 3 + (c - '0');
+    if (c >= 'A' && c <= 'Z') return 13 + (c - 'A');
+    if (c == '%') return 1;
+    if (c == '.') return 2;
+    return 0;
+}
+
+Hud::Hud()
+{
+    visible = false;
+
+    memset(frameHistory, 0, sizeof(frameHistory));
+    historyHead = 0;
+
+    windowNs = 0;
+    windowPresentNs = 0;
+    windowIdleNs = 0;
+    windowInstructions = 0;
+    windowFrames = 0;
+
+    ips = 0;
+    frameMs = 0;
+    presentMs = 0;
+    idlePercent = 0;
+}
+
+void Hud::Frame(uint64_t frameNs, uint64_t presentNs, uint64_t idleNs, uint64_t instructions)
+{
+    frameHistory[historyHead] = frameNs;
+    historyHead = (historyHead + 1) % HISTORY;
+
+    windowNs += frameNs;
+    windowPresentNs += presentNs;
+    windowIdleNs += idleNs;
+    windowInstructions += instructions;
+    windowFrames++;
+
+    if (windowNs < REFRESH_NS) return;
+
+    ips = windowInstructions * 1e9 / windowNs;
+    frameMs = windowNs / 1e6 / windowFrames;
+    presentMs = windowPresentNs / 1e6 / windowFrames;
+    idlePercent = 100.0 * windowIdleNs / windowNs;
+
+    windowNs = 0;
+    windowPresentNs = 0;
+    windowIdleNs = 0;
+    windowInstructions = 0;
+    windowFrames = 0;
+}
+
+void Hud::DrawText(uint32_t* pixels, int x, int y, const char* text) const
+{
+    for (; *text != '\0' && x + 3 <= WIDTH; text++, x += 4)
+    {
+        const uint8_t* glyph = glyphs[GlyphIndex(*text)];
+        for (int row = 0; row < 5; row++)
+        {
+            for (int col = 0; col < 3; col++)
+            {
+                if (glyph[row] & (4 >> col)) pixels[(y + row) * WIDTH + x + col] = TEXT;
+            }
+        }
+    }
+}
+
+void Hud::Render(uint32_t* pixels) const
+{
+    for (int i = 0; i < WIDTH * HEIGHT; i++) pixels[i] = BACKGROUND;
+
+    char line[32];
+    snprintf(line, sizeof(line), "IPS %.0f", ips);
+    DrawText(pixels, 2, 2, line);
+    snprintf(line, sizeof(line), "FRAME %.2f MS", frameMs);
+    DrawText(pixels, 2, 8, line);
+    snprintf(line, sizeof(line), "PRESENT %.2f MS", presentMs);
+    DrawText(pixels, 2, 14, line);
+    snprintf(line, sizeof(line), "IDLE %.0f%%", idlePercent);
+    DrawText(pixels, 2, 20, line);
+
+    // Frame time graph along the bottom, oldest frame on the left
+    const int graphTop = 27;
+    const int graphHeight = HEIGHT - graphTop - 2;
+    const int targetRow = HEIGHT - 2 - (int)(BUDGET_NS * graphHeight / GRAPH_NS);
+
+    for (int x = 0; x < HISTORY; x++)
+    {
+        uint64_t ns = frameHistory[(historyHead + x) % HISTORY];
+        int height = (int)((ns < GRAPH_NS ? ns : GRAPH_NS) * graphHeight / GRAPH_NS);
+        uint32_t color = ns > BUDGET_NS + BUDGET_NS / 10 ? SLOW_BAR : BAR;
+
+        for (int y = 0; y < height; y++) pixels[(HEIGHT - 2 - y) * WIDTH + 2 + x] = color;
+        if (height <= HEIGHT - 2 - targetRow) pixels[targetRow * WIDTH + 2 + x] = TARGET_LINE;
+    }
+}
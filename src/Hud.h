@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Performance overlay for the frontend
+ *
+ * Keeps a short history of frame timings and rasterizes IPS, frame time, present latency, idle
+ * share and a frame time graph into an ARGB8888 buffer with a built-in 3x5 font. Nothing here
+ * touches SDL; the frontend uploads the buffer to a blended texture drawn over the game.
+ */
+class Hud
+{
+public:
+    static const int WIDTH = 128;
+    static const int HEIGHT = 48;
+
+    Hud(void);
+
+    // Timings of the frame that just finished, and the emulated instructions it ran
+    void Frame(uint64_t frameNs, uint64_t presentNs, uint64_t idleNs, uint64_t instructions);
+
+    // Draws the overlay into WIDTH * HEIGHT ARGB8888 pixels
+    void Render(uint32_t* pixels) const;
+
+    bool visible;
+private:
+    // Frames shown in the graph, one column each
+    static const int HISTORY = WIDTH - 4;
+
+    // Readouts are refreshed this often so the digits stay legible
+    static const uint64_t REFRESH_NS = 500000000;
+
+    void DrawText(uint32_t* pixels, int x, int y, const char* text) const;
+
+    uint64_t frameHistory[HISTORY];
+    int historyHead;
+
+    uint64_t windowNs;
+    uint64_t windowPresentNs;
+    uint64_t windowIdleNs;
+    uint64_t windowInstructions;
+    uint64_t windowFrames;
+
+    double ips;
+    double frameMs;
+    double presentMs;
+    double idlePercent;
+};
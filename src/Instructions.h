@@ -0,0 +1,261 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Chip8.h"
+
+/*
+ * Instruction semantics shared by the execution engines
+ *
+ * Decode() names the instruction an opcode encodes, and the helpers below do exactly what the
+ * matching case in Chip8::Update does, minus the trace, profile, memory-tracking and probe hooks,
+ * which only the reference interpreter has. Helpers leave pc alone unless the instruction itself
+ * sets it, so engines can fold the usual pc += 2 into their own dispatch.
+ *
+ * Opcodes Update does not know (FALLBACK) are handed back to Update, which reports them and
+ * leaves pc where it is.
+ *
+ * Helpers for instructions a quirk profile changes take the profile type (see Quirks.h) as a
+ * template argument; engines instantiate their run loop once per profile and pass it through.
+ * Under BOUNDS_FAULT engines ask Chip8::Check before each instruction and hand the ones that fault
+ * to Update, which halts the machine; the helpers themselves only ever wrap.
+ */
+class Instructions
+{
+public:
+    enum Kind
+    {
+        FALLBACK,
+        CLS_00E0,
+        RET_00EE,
+        JP_1NNN,
+        CALL_2NNN,
+        SE_3XKK,
+        SNE_4XKK,
+        SE_5XY0,
+        LD_6XKK,
+        ADD_7XKK,
+        LD_8XY0,
+        OR_8XY1,
+        AND_8XY2,
+        XOR_8XY3,
+        ADD_8XY4,
+        SUB_8XY5,
+        SHR_8XY6,
+        SUBN_8XY7,
+        SHL_8XYE,
+        SNE_9XY0,
+        LD_ANNN,
+        JP_BNNN,
+        RND_CXKK,
+        DRW_DXYN,
+        SKP_EX9E,
+        SKNP_EXA1,
+        LD_FX07,
+        LD_FX0A,
+        LD_FX15,
+        LD_FX18,
+        ADD_FX1E,
+        LD_FX29,
+        BCD_FX33,
+        LD_FX55,
+        LD_FX65,
+        KIND_COUNT
+    };
+
+    static Kind Decode(uint16_t opcode)
+    {
+        switch (opcode >> 12)
+        {
+            // Update only looks at the low byte, so 0nE0 and 0nEE behave like 00E0 and 00EE
+            case 0x0: return (opcode & 0xFF) == 0xE0 ? CLS_00E0 : (opcode & 0xFF) == 0xEE ? RET_00EE : FALLBACK;
+            case 0x1: return JP_1NNN;
+            case 0x2: return CALL_2NNN;
+            case 0x3: return SE_3XKK;
+            case 0x4: return SNE_4XKK;
+
+            // Update ignores the low nibble of 5xy0 and 9xy0
+            case 0x5: return SE_5XY0;
+            case 0x6: return LD_6XKK;
+            case 0x7: return ADD_7XKK;
+            case 0x8:
+            {
+                static const Kind alu[16] = {LD_8XY0, OR_8XY1, AND_8XY2, XOR_8XY3, ADD_8XY4, SUB_8XY5, SHR_8XY6, SUBN_8XY7,
+                                             FALLBACK, FALLBACK, FALLBACK, FALLBACK, FALLBACK, FALLBACK, SHL_8XYE, FALLBACK};
+                return alu[opcode & 0xF];
+            }
+            case 0x9: return SNE_9XY0;
+            case 0xA: return LD_ANNN;
+            case 0xB: return JP_BNNN;
+            case 0xC: return RND_CXKK;
+            case 0xD: return DRW_DXYN;
+            case 0xE: return (opcode & 0xFF) == 0x9E ? SKP_EX9E : (opcode & 0xFF) == 0xA1 ? SKNP_EXA1 : FALLBACK;
+            default:
+            {
+                switch (opcode & 0xFF)
+                {
+                    case 0x07: return LD_FX07;
+                    case 0x0A: return LD_FX0A;
+                    case 0x15: return LD_FX15;
+                    case 0x18: return LD_FX18;
+                    case 0x1E: return ADD_FX1E;
+                    case 0x29: return LD_FX29;
+                    case 0x33: return BCD_FX33;
+                    case 0x55: return LD_FX55;
+                    case 0x65: return LD_FX65;
+                    default: return FALLBACK;
+                }
+            }
+        }
+    }
+
+    static uint16_t Fetch(const Chip8& chip8, uint16_t address) { return (chip8.Read(address) << 8) | chip8.Read(address + 1); }
+
+    static uint8_t* V(Chip8& chip8) { return chip8.registers; }
+    static uint16_t& I(Chip8& chip8) { return chip8.I; }
+    static uint16_t& PC(Chip8& chip8) { return chip8.pc; }
+    static uint8_t& DelayTimer(Chip8& chip8) { return chip8.delayTimer; }
+    static uint8_t& SoundTimer(Chip8& chip8) { return chip8.soundTimer; }
+    static uint8_t Random(Chip8& chip8) { return chip8.Random(); }
+
+    // Update ends every instruction by counting both timers down
+    static void Tick(Chip8& chip8)
+    {
+        if (chip8.delayTimer > 0) chip8.delayTimer--;
+        if (chip8.soundTimer > 0) chip8.soundTimer--;
+    }
+
+    // The same as calling Tick n times, on timers the caller holds, for code that runs several instructions in between
+    static void Tick(uint8_t& delay, uint8_t& sound, int n)
+    {
+        delay = delay > n ? delay - n : 0;
+        sound = sound > n ? sound - n : 0;
+    }
+
+    static void Clear(Chip8& chip8)
+    {
+        for (int i = 0; i < 2048; i++) chip8.display[i] = 0;
+        chip8.displayHash = 0;
+        chip8.drawFlag = true;
+    }
+
+    static void Call(Chip8& chip8, uint16_t target)
+    {
+        chip8.stack[chip8.sp & 0xF] = chip8.pc;
+        chip8.sp++;
+        chip8.pc = target;
+    }
+
+    static void Return(Chip8& chip8)
+    {
+        chip8.pc = chip8.stack[--chip8.sp & 0xF] + 2;
+    }
+
+    /*
+     * The helpers below come in two forms. The ones taking a Chip8 alone work on its registers; the
+     * ones also taking register values or references work on whatever the caller passes, so an
+     * engine holding V, I and pc in locals can use them without writing its state back first.
+     */
+
+    // Draws the n-row sprite at I and returns the new VF: 1 if any lit pixel was cleared
+    template <class Q>
+    static uint8_t Draw(Chip8& chip8, uint8_t xPos, uint8_t yPos, uint16_t I, uint8_t n)
+    {
+        if (Q::SPRITES_CLIP)
+        {
+            xPos %= 64;
+            yPos %= 32;
+        }
+
+        uint8_t collision = 0;
+        for (uint8_t yLine = 0; yLine < n; yLine++)
+        {
+            if (Q::SPRITES_CLIP && yPos + yLine >= 32) break;
+
+            uint8_t lineSprite = chip8.Read(I + yLine);
+            for (uint8_t xLine = 0; xLine < 8; xLine++)
+            {
+                if (Q::SPRITES_CLIP && xPos + xLine >= 64) break;
+
+                if ((lineSprite & (0x80 >> xLine)) != 0)
+                {
+                    int pixel = (((yPos + yLine) % 32) * 64) + ((xPos + xLine) % 64);
+                    if (chip8.display[pixel] == 1) collision = 1;
+
+                    chip8.display[pixel] ^= 1;
+                    chip8.displayHash ^= Chip8::PixelKey(pixel);
+                }
+            }
+        }
+        chip8.drawFlag = true;
+        return collision;
+    }
+
+    // Positions are read before VF is written, so x or y == F reads VF as it was
+    template <class Q>
+    static void Draw(Chip8& chip8, uint8_t x, uint8_t y, uint8_t n)
+    {
+        chip8.registers[0xF] = Draw<Q>(chip8, chip8.registers[x], chip8.registers[y], chip8.I, n);
+    }
+
+    static bool KeyPressed(const Chip8& chip8, uint8_t value) { return chip8.key[value & 0xF] == 1; }
+    static bool KeyDown(const Chip8& chip8, uint8_t x) { return KeyPressed(chip8, chip8.registers[x]); }
+
+    // FX0A: pc moves on by 2 for every key held, as in Update, and stays put when none are; returns the new pc
+    static uint16_t WaitKey(const Chip8& chip8, uint8_t& vx, uint16_t pc)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            if (chip8.key[i] == 1)
+            {
+                vx = i;
+                pc += 2;
+            }
+        }
+        return pc;
+    }
+
+    static void WaitKey(Chip8& chip8, uint8_t x)
+    {
+        chip8.pc = WaitKey(chip8, chip8.registers[x], chip8.pc);
+    }
+
+    static void Bcd(Chip8& chip8, uint16_t I, uint8_t value)
+    {
+        chip8.Write(I, value / 100);
+        chip8.Write(I + 1, (value / 10) % 10);
+        chip8.Write(I + 2, value % 10);
+    }
+
+    static void Bcd(Chip8& chip8, uint8_t x)
+    {
+        Bcd(chip8, chip8.I, chip8.registers[x]);
+    }
+
+    // FX55 and FX65 leave I where the profile says; capture I first to know where a store went
+    template <class Q>
+    static void Store(Chip8& chip8, const uint8_t* V, uint16_t& I, uint8_t x)
+    {
+        for (int i = 0; i <= x; i++) chip8.Write(I + i, V[i]);
+        I += IndexStep<Q>(x);
+    }
+
+    template <class Q>
+    static void Load(const Chip8& chip8, uint8_t* V, uint16_t& I, uint8_t x)
+    {
+        for (int i = 0; i <= x; i++) V[i] = chip8.Read(I + i);
+        I += IndexStep<Q>(x);
+    }
+
+    template <class Q>
+    static void Store(Chip8& chip8, uint8_t x)
+    {
+        Store<Q>(chip8, chip8.registers, chip8.I, x);
+    }
+
+    template <class Q>
+    static void Load(Chip8& chip8, uint8_t x)
+    {
+        Load<Q>(chip8, chip8.registers, chip8.I, x);
+    }
+};
@@ -0,0 +1,68 @@
+#include "MemoryTracker.h"
+
+#include <cmath>
+
+MemoryTracker::MemoryTracker(bool withCounters)
+{
+    for (int a = 0; a < ACCESS_COUNT; a++)
+    {
+        for (int i = 0; i < 4096 / 64; i++) bits[a][i] = 0;
+    }
+
+    if (withCounters) counts.assign(ACCESS_COUNT * 4096, 0);
+}
+
+void MemoryTracker::WriteCsv(std::ostream& out) const
+{
+    out << "address,executed,read,written";
+    if (!counts.empty()) out << ",execute_count,read_count,write_count";
+    out << "\n";
+
+    for (int address = 0; address < 4096; address++)
+    {
+        out << address << "," << Has(EXECUTE, address) << "," << Has(READ, address) << "," << Has(WRITE, address);
+        if (!counts.empty())
+        {
+            out << "," << Count(EXECUTE, address) << "," << Count(READ, address) << "," << Count(WRITE, address);
+        }
+        out << "\n";
+    }
+}
+
+void MemoryTracker::WriteImage(std::ostream& out, int cellSize) const
+{
+    // Normalise counts against the busiest address of each kind
+    double maxLog[ACCESS_COUNT];
+    for (int a = 0; a < ACCESS_COUNT; a++)
+    {
+        uint32_t highest = 1;
+        for (int address = 0; address < 4096; address++)
+        {
+            if (Count((Access)a, address) > highest) highest = Count((Access)a, address);
+        }
+        maxLog[a] = std::log(1.0 + highest);
+    }
+
+    int size = 64 * cellSize;
+    out << "P6\n" << size << " " << size << "\n255\n";
+
+    for (int y = 0; y < size; y++)
+    {
+        for (int x = 0; x < size; x++)
+        {
+            int address = (y / cellSize) * 64 + x / cellSize;
+            uint8_t pixel[3];
+
+            static const Access channels[3] = {WRITE, EXECUTE, READ};
+            for (int c = 0; c < 3; c++)
+            {
+                uint32_t count = Count(channels[c], address);
+                if (count == 0) pixel[c] = 0;
+                else if (counts.empty()) pixel[c] = 255;
+                else pixel[c] = (uint8_t)(64 + 191 * std::log(1.0 + count) / maxLog[channels[c]]);
+            }
+
+            out.write((const char*)pixel, 3);
+        }
+    }
+}
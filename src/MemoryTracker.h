@@ -0,0 +1,46 @@
+#pragma once
+
+#include <ostream>
+#include <stdint.h>
+#include <vector>
+
+/*
+ * Per-address record of how a ROM uses memory: executed as an instruction, read through I (Dxyn,
+ * Fx65) or written (Fx33, Fx55). The core feeds it only when built with CHIP8_TRACK_MEMORY.
+ *
+ * The three bitmaps are always kept; per-address counters are optional since they are 48KB and
+ * cost an extra increment per event.
+ */
+class MemoryTracker
+{
+public:
+    enum Access
+    {
+        EXECUTE,
+        READ,
+        WRITE,
+        ACCESS_COUNT
+    };
+
+    MemoryTracker(bool withCounters);
+
+    void Record(Access access, uint16_t address)
+    {
+        address &= 0xFFF;
+        bits[access][address >> 6] |= 1ULL << (address & 63);
+        if (!counts.empty()) counts[access * 4096 + address]++;
+    }
+
+    bool Has(Access access, uint16_t address) const { return (bits[access][(address & 0xFFF) >> 6] >> (address & 63)) & 1; }
+    uint32_t Count(Access access, uint16_t address) const { return counts.empty() ? Has(access, address) : counts[access * 4096 + (address & 0xFFF)]; }
+
+    // address,executed,read,written and, with counters, how often each happened
+    void WriteCsv(std::ostream& out) const;
+
+    // 64x64 grid of addresses, one cell per byte, as a binary PPM: green executed, blue read, red
+    // written; with counters the brightness follows the access count on a log scale
+    void WriteImage(std::ostream& out, int cellSize) const;
+private:
+    uint64_t bits[ACCESS_COUNT][4096 / 64];
+    std::vector<uint32_t> counts;
+};
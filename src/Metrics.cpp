@@ -0,0 +1,205 @@
+#include "Metrics.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static const char* stageNames[Metrics::STAGE_COUNT] = {"emulate", "convert", "upload", "present", "idle"};
+
+static uint64_t ProcessCpuNs()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000ULL
+           + (uint64_t)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000ULL;
+}
+
+Metrics& Metrics::Instance()
+{
+    static Metrics metrics;
+    return metrics;
+}
+
+Metrics::Metrics()
+{
+    intervalMs = 1000;
+    socketFd = -1;
+    running = false;
+}
+
+Metrics::~Metrics()
+{
+    Stop();
+}
+
+Metrics::Counters& Metrics::Local()
+{
+    // Registered once per thread; blocks outlive their threads so the exporter never sees a dangling one
+    thread_local Counters* counters = nullptr;
+    if (counters == nullptr)
+    {
+        std::unique_ptr<Counters> block(new Counters());
+        counters = block.get();
+
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry.push_back(std::move(block));
+    }
+    return *counters;
+}
+
+void Metrics::FrameTime(uint64_t ns)
+{
+    uint64_t bucket = ns / BUCKET_NS;
+    Local().frameTimes[bucket < BUCKETS ? bucket : BUCKETS - 1].fetch_add(1, std::memory_order_relaxed);
+}
+
+bool Metrics::Start(const std::string& destination, int interval)
+{
+    if (running) return false;
+
+    target = destination;
+    intervalMs = interval > 0 ? interval : 1000;
+    running = true;
+    exporter = std::thread(&Metrics::Export, this);
+    return true;
+}
+
+void Metrics::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(exportMutex);
+        if (!running) return;
+        running = false;
+    }
+    stopSignal.notify_all();
+    exporter.join();
+
+    if (socketFd >= 0) close(socketFd);
+    socketFd = -1;
+}
+
+Metrics::Totals Metrics::Collect()
+{
+    Totals totals;
+    totals.instructions = 0;
+    totals.framesPresented = 0;
+    totals.framesDropped = 0;
+    for (int s = 0; s < STAGE_COUNT; s++) totals.stageNs[s] = 0;
+    totals.frameTimes.assign(BUCKETS, 0);
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (size_t i = 0; i < registry.size(); i++)
+    {
+        Counters& c = *registry[i];
+        totals.instructions += c.instructions.load(std::memory_order_relaxed);
+        totals.framesPresented += c.framesPresented.load(std::memory_order_relaxed);
+        totals.framesDropped += c.framesDropped.load(std::memory_order_relaxed);
+        for (int s = 0; s < STAGE_COUNT; s++) totals.stageNs[s] += c.stageNs[s].load(std::memory_order_relaxed);
+        for (int b = 0; b < BUCKETS; b++) totals.frameTimes[b] += c.frameTimes[b].load(std::memory_order_relaxed);
+    }
+    return totals;
+}
+
+void Metrics::Export()
+{
+    Totals previous = Collect();
+    uint64_t previousCpu = ProcessCpuNs();
+    std::chrono::steady_clock::time_point previousTime = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex> lock(exportMutex);
+    while (running)
+    {
+        stopSignal.wait_for(lock, std::chrono::milliseconds(intervalMs));
+
+        Totals now = Collect();
+        uint64_t cpu = ProcessCpuNs();
+        std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now();
+
+        double wallNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(time - previousTime).count();
+        uint64_t frames = 0;
+        for (int b = 0; b < BUCKETS; b++) frames += now.frameTimes[b] - previous.frameTimes[b];
+
+        // Percentiles from this interval's share of the histogram, reported at the bucket's upper edge
+        double percentiles[3] = {0, 0, 0};
+        static const double ranks[3] = {0.50, 0.95, 0.99};
+        uint64_t seen = 0;
+        int next = 0;
+        for (int b = 0; b < BUCKETS && next < 3 && frames > 0; b++)
+        {
+            seen += now.frameTimes[b] - previous.frameTimes[b];
+            while (next < 3 && seen >= ranks[next] * frames)
+            {
+                percentiles[next] = (b + 1) * BUCKET_NS / 1e6;
+                next++;
+            }
+        }
+
+        std::ostringstream line;
+        line << "{\"ts_ms\":" << std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::system_clock::now().time_since_epoch()).count()
+             << ",\"interval_ms\":" << wallNs / 1e6
+             << ",\"ips\":" << (now.instructions - previous.instructions) * 1e9 / wallNs
+             << ",\"frames\":" << frames
+             << ",\"frames_presented\":" << now.framesPresented - previous.framesPresented
+             << ",\"frames_dropped\":" << now.framesDropped - previous.framesDropped
+             << ",\"frame_time_ms\":{\"p50\":" << percentiles[0] << ",\"p95\":" << percentiles[1]
+             << ",\"p99\":" << percentiles[2] << "},\"stage_ms\":{";
+        for (int s = 0; s < STAGE_COUNT; s++)
+        {
+            uint64_t ns = now.stageNs[s] - previous.stageNs[s];
+            line << (s ? "," : "") << "\"" << stageNames[s] << "\":" << (frames > 0 ? ns / 1e6 / frames : 0);
+        }
+        line << "},\"idle_ratio\":" << (now.stageNs[IDLE] - previous.stageNs[IDLE]) / wallNs
+             << ",\"cpu_percent\":" << 100.0 * (cpu - previousCpu) / wallNs << "}\n";
+
+        Emit(line.str());
+
+        previous = now;
+        previousCpu = cpu;
+        previousTime = time;
+    }
+}
+
+bool Metrics::Emit(const std::string& line)
+{
+    if (target.compare(0, 5, "unix:") != 0)
+    {
+        std::ofstream file(target.c_str(), std::ios::app);
+        file << line;
+        return file.good();
+    }
+
+    // Reconnect lazily so a collector that restarts picks the stream back up
+    if (socketFd < 0)
+    {
+        std::string path = target.substr(5);
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+        socketFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (socketFd < 0) return false;
+        if (connect(socketFd, (sockaddr*)&address, sizeof(address)) < 0)
+        {
+            close(socketFd);
+            socketFd = -1;
+            return false;
+        }
+    }
+
+    if (send(socketFd, line.data(), line.size(), MSG_NOSIGNAL) != (ssize_t)line.size())
+    {
+        close(socketFd);
+        socketFd = -1;
+        return false;
+    }
+    return true;
+}
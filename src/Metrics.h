@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Runtime metrics exported as JSON lines
+ *
+ * Every thread that reports gets its own block of relaxed atomic counters, so recording is a
+ * plain increment with no shared cache lines or locks. An exporter thread sums the blocks every
+ * interval and appends one line to a file, or sends it to a local Unix socket when the target is
+ * "unix:<path>":
+ *
+ *   {"ts_ms":..., "interval_ms":..., "ips":..., "frames":..., "frames_presented":..., "frames_dropped":...,
+ *    "frame_time_ms":{"p50":...,"p95":...,"p99":...}, "stage_ms":{"emulate":...,...},
+ *    "idle_ratio":..., "cpu_percent":...}
+ *
+ * Frame times and stage times cover every frame the loop ran, whether or not it presented; stage
+ * times are averaged per frame and idle_ratio is the share of wall time spent in the IDLE stage.
+ */
+class Metrics
+{
+public:
+    enum Stage
+    {
+        EMULATE,
+        CONVERT,
+        UPLOAD,
+        PRESENT,
+        IDLE,
+        STAGE_COUNT
+    };
+
+    static Metrics& Instance(void);
+
+    bool Start(const std::string& target, int intervalMs);
+    void Stop(void);
+
+    void AddInstructions(uint64_t count) { Local().instructions.fetch_add(count, std::memory_order_relaxed); }
+    void AddStageTime(Stage stage, uint64_t ns) { Local().stageNs[stage].fetch_add(ns, std::memory_order_relaxed); }
+    void FramePresented(void) { Local().framesPresented.fetch_add(1, std::memory_order_relaxed); }
+    void FrameDropped(void) { Local().framesDropped.fetch_add(1, std::memory_order_relaxed); }
+    void FrameTime(uint64_t ns);
+private:
+    // Frame times land in 50us buckets up to 100ms; anything longer goes in the last one
+    static const int BUCKETS = 2001;
+    static const uint64_t BUCKET_NS = 50000;
+
+    struct Counters
+    {
+        std::atomic<uint64_t> instructions;
+        std::atomic<uint64_t> framesPresented;
+        std::atomic<uint64_t> framesDropped;
+        std::atomic<uint64_t> stageNs[STAGE_COUNT];
+        std::atomic<uint64_t> frameTimes[BUCKETS];
+    };
+
+    struct Totals
+    {
+        uint64_t instructions;
+        uint64_t framesPresented;
+        uint64_t framesDropped;
+        uint64_t stageNs[STAGE_COUNT];
+        std::vector<uint64_t> frameTimes;
+    };
+
+    Metrics(void);
+    ~Metrics(void);
+
+    Counters& Local(void);
+    Totals Collect(void);
+    void Export(void);
+    bool Emit(const std::string& line);
+
+    std::mutex registryMutex;
+    std::vector<std::unique_ptr<Counters> > registry;
+
+    std::string target;
+    int intervalMs;
+    int socketFd;
+
+    bool running;
+    std::mutex exportMutex;
+    std::condition_variable stopSignal;
+    std::thread exporter;
+};
@@ -0,0 +1,362 @@
+#include "Netplay.h"
+
+#include <chrono>
+#include <iostream>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/*
+ * Packet layout: magic, player, sender's frame, first input frame, input count, how many inputs the
+ * sender has from each player, the frame the sender last heard each player report, then `count` key masks
+ */
+static const uint8_t PACKET_MAGIC = 0xC8;
+static const size_t PACKET_ACKS = 11;
+static const size_t PACKET_FRAMES = PACKET_ACKS + 4 * 4;
+static const size_t PACKET_HEADER = PACKET_FRAMES + 4 * 4;
+
+static uint64_t NowMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void Put32(uint8_t* p, uint32_t v)
+{
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static uint32_t Get32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+NetplayTransport::NetplayTransport()
+{
+    socketFd = -1;
+    latencyMs = 0;
+    jitterMs = 0;
+    jitterState = 0x9E3779B9;
+}
+
+NetplayTransport::~NetplayTransport()
+{
+    if (socketFd >= 0) close(socketFd);
+}
+
+bool NetplayTransport::Open(uint16_t localPort)
+{
+    socketFd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (socketFd < 0)
+    {
+        std::cerr << "Failed to create netplay socket" << std::endl;
+        return false;
+    }
+
+    sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    local.sin_port = htons(localPort);
+
+    if (bind(socketFd, (sockaddr*)&local, sizeof(local)) < 0)
+    {
+        std::cerr << "Failed to bind netplay port " << localPort << std::endl;
+        return false;
+    }
+
+    fcntl(socketFd, F_SETFL, fcntl(socketFd, F_GETFL) | O_NONBLOCK);
+    return true;
+}
+
+uint16_t NetplayTransport::LocalPort() const
+{
+    sockaddr_in local;
+    socklen_t length = sizeof(local);
+    if (socketFd < 0 || getsockname(socketFd, (sockaddr*)&local, &length) < 0) return 0;
+    return ntohs(local.sin_port);
+}
+
+bool NetplayTransport::AddPeer(const char* host, uint16_t port)
+{
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host, nullptr, &hints, &result) != 0 || result == nullptr)
+    {
+        std::cerr << "Failed to resolve netplay peer " << host << std::endl;
+        return false;
+    }
+
+    sockaddr_in peer = *(sockaddr_in*)result->ai_addr;
+    peer.sin_port = htons(port);
+    peers.push_back(peer);
+
+    freeaddrinfo(result);
+    return true;
+}
+
+void NetplayTransport::SetSimulatedLatency(int latency, int jitter)
+{
+    latencyMs = latency;
+    jitterMs = jitter;
+}
+
+void NetplayTransport::Send(const uint8_t* data, size_t size)
+{
+    if (latencyMs == 0 && jitterMs == 0)
+    {
+        for (size_t i = 0; i < peers.size(); i++)
+            sendto(socketFd, data, size, 0, (const sockaddr*)&peers[i], sizeof(peers[i]));
+        return;
+    }
+
+    // xorshift32; jittered packets may overtake each other, which the redundant inputs cover
+    jitterState ^= jitterState << 13;
+    jitterState ^= jitterState >> 17;
+    jitterState ^= jitterState << 5;
+
+    Delayed packet;
+    packet.due = NowMs() + latencyMs + (jitterMs > 0 ? jitterState % (jitterMs + 1) : 0);
+    packet.data.assign(data, data + size);
+    outgoing.push_back(packet);
+
+    Flush();
+}
+
+void NetplayTransport::Flush()
+{
+    uint64_t now = NowMs();
+
+    for (std::deque<Delayed>::iterator it = outgoing.begin(); it != outgoing.end();)
+    {
+        if (it->due > now)
+        {
+            ++it;
+            continue;
+        }
+
+        for (size_t i = 0; i < peers.size(); i++)
+            sendto(socketFd, it->data.data(), it->data.size(), 0, (const sockaddr*)&peers[i], sizeof(peers[i]));
+        it = outgoing.erase(it);
+    }
+}
+
+size_t NetplayTransport::Receive(uint8_t* data, size_t size)
+{
+    Flush();
+
+    ssize_t result = recv(socketFd, data, size, 0);
+    return result > 0 ? (size_t)result : 0;
+}
+
+RollbackSession::RollbackSession(Chip8& chip8, NetplayTransport& net, int players, int local, int delay)
+    : machine(chip8), transport(net)
+{
+    playerCount = players < 1 ? 1 : players < MAX_PLAYERS ? players : MAX_PLAYERS;
+    localPlayer = local < 0 ? 0 : local < playerCount ? local : playerCount - 1;
+    inputDelay = delay < 0 ? 0 : delay < MAX_ROLLBACK ? delay : MAX_ROLLBACK;
+
+    frame = 0;
+    rollbacks = 0;
+    resimulatedFrames = 0;
+    rollbackTo = UINT32_MAX;
+
+    for (int p = 0; p < MAX_PLAYERS; p++)
+    {
+        for (int i = 0; i < HISTORY; i++)
+        {
+            inputs[p][i] = 0;
+            predicted[p][i] = 0;
+        }
+
+        // Nobody presses anything during the input delay at the start of the session
+        confirmed[p] = inputDelay;
+        remoteFrame[p] = 0;
+        remoteAdvantage[p] = 0;
+        acked[p] = inputDelay;
+    }
+}
+
+bool RollbackSession::AdvanceFrame(uint16_t localKeys)
+{
+    // The local input is scheduled inputDelay frames out, which hides that much latency without rollback
+    uint32_t target = frame + inputDelay;
+    if (confirmed[localPlayer] == target && target < Unacked() + REDUNDANCY)
+    {
+        inputs[localPlayer][target % HISTORY] = localKeys;
+        confirmed[localPlayer] = target + 1;
+    }
+
+    Poll();
+
+    // Predictions only reach MAX_ROLLBACK frames past the last real input we have from each peer,
+    // and the local input for this frame may still be waiting on acknowledgements
+    if (confirmed[localPlayer] <= target) return false;
+    for (int p = 0; p < playerCount; p++)
+    {
+        if (frame >= confirmed[p] + MAX_ROLLBACK) return false;
+    }
+
+    Simulate(machine, frame);
+    frame++;
+    return true;
+}
+
+void RollbackSession::Poll()
+{
+    SendInputs();
+    ReceiveInputs();
+
+    // Replays run on a clone so a profiler attached to the machine sees each frame once
+    if (rollbackTo < frame)
+    {
+        Chip8 replay = snapshots[rollbackTo % HISTORY];
+        for (uint32_t f = rollbackTo; f < frame; f++)
+        {
+            Simulate(replay, f);
+            resimulatedFrames++;
+        }
+        machine.Restore(replay);
+        rollbacks++;
+    }
+    rollbackTo = UINT32_MAX;
+}
+
+uint32_t RollbackSession::ConfirmedFrames() const
+{
+    uint32_t oldest = confirmed[0];
+    for (int p = 1; p < playerCount; p++)
+    {
+        if (confirmed[p] < oldest) oldest = confirmed[p];
+    }
+    return oldest;
+}
+
+int RollbackSession::FramesAhead() const
+{
+    // Latency makes every peer look behind from where it is observed, so compare our lead over each
+    // peer with that peer's lead over us and split the difference
+    int ahead = 0;
+    for (int p = 0; p < playerCount; p++)
+    {
+        if (p == localPlayer) continue;
+
+        int diff = ((int)frame - (int)remoteFrame[p] - remoteAdvantage[p]) / 2;
+        if (diff > ahead) ahead = diff;
+    }
+    return ahead;
+}
+
+uint32_t RollbackSession::Unacked() const
+{
+    uint32_t oldest = confirmed[localPlayer];
+    for (int p = 0; p < playerCount; p++)
+    {
+        if (p != localPlayer && acked[p] < oldest) oldest = acked[p];
+    }
+    return oldest;
+}
+
+void RollbackSession::Simulate(Chip8& target, uint32_t f)
+{
+    snapshots[f % HISTORY] = target.Clone();
+
+    uint16_t keys = InputFor(f);
+    for (int i = 0; i < 16; i++) target.key[i] = (keys >> i) & 1;
+
+    target.RunFrame();
+}
+
+uint16_t RollbackSession::InputFor(uint32_t f)
+{
+    uint16_t keys = 0;
+
+    for (int p = 0; p < playerCount; p++)
+    {
+        uint16_t input;
+        if (f < confirmed[p])
+        {
+            input = inputs[p][f % HISTORY];
+        } else {
+            input = confirmed[p] > 0 ? inputs[p][(confirmed[p] - 1) % HISTORY] : 0;
+            predicted[p][f % HISTORY] = input;
+        }
+        keys |= input;
+    }
+
+    return keys;
+}
+
+void RollbackSession::SendInputs()
+{
+    uint8_t packet[PACKET_HEADER + 2 * REDUNDANCY];
+
+    uint32_t end = confirmed[localPlayer];
+    uint32_t start = Unacked();
+
+    packet[0] = PACKET_MAGIC;
+    packet[1] = localPlayer;
+    Put32(&packet[2], frame);
+    Put32(&packet[6], start);
+    packet[10] = end - start;
+    for (int p = 0; p < MAX_PLAYERS; p++)
+    {
+        Put32(&packet[PACKET_ACKS + 4 * p], confirmed[p]);
+        Put32(&packet[PACKET_FRAMES + 4 * p], remoteFrame[p]);
+    }
+
+    for (uint32_t f = start; f < end; f++)
+    {
+        uint16_t keys = inputs[localPlayer][f % HISTORY];
+        packet[PACKET_HEADER + 2 * (f - start)] = keys >> 8;
+        packet[PACKET_HEADER + 2 * (f - start) + 1] = keys & 0xFF;
+    }
+
+    transport.Send(packet, PACKET_HEADER + 2 * (end - start));
+}
+
+void RollbackSession::ReceiveInputs()
+{
+    uint8_t packet[PACKET_HEADER + 2 * REDUNDANCY];
+    size_t size;
+
+    while ((size = transport.Receive(packet, sizeof(packet))) > 0)
+    {
+        if (size < PACKET_HEADER || packet[0] != PACKET_MAGIC) continue;
+
+        int player = packet[1];
+        uint32_t start = Get32(&packet[6]);
+        uint32_t count = packet[10];
+        if (player >= playerCount || player == localPlayer || size < PACKET_HEADER + 2 * count) continue;
+
+        uint32_t reported = Get32(&packet[2]);
+        if (reported > remoteFrame[player])
+        {
+            remoteFrame[player] = reported;
+            remoteAdvantage[player] = (int)reported - (int)Get32(&packet[PACKET_FRAMES + 4 * localPlayer]);
+        }
+
+        uint32_t ack = Get32(&packet[PACKET_ACKS + 4 * localPlayer]);
+        if (ack > acked[player]) acked[player] = ack;
+
+        for (uint32_t f = start; f < start + count; f++)
+        {
+            // Only the next missing input is useful; anything older is already confirmed
+            if (f != confirmed[player]) continue;
+
+            uint16_t keys = (packet[PACKET_HEADER + 2 * (f - start)] << 8) | packet[PACKET_HEADER + 2 * (f - start) + 1];
+            inputs[player][f % HISTORY] = keys;
+            confirmed[player] = f + 1;
+
+            if (f < frame && keys != predicted[player][f % HISTORY] && f < rollbackTo) rollbackTo = f;
+        }
+    }
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <deque>
+#include <stdint.h>
+#include <vector>
+
+#include <netinet/in.h>
+
+#include "Chip8.h"
+
+/*
+ * UDP transport between netplay peers
+ *
+ * Every packet carries the sender's recent inputs, so lost or reordered packets are covered by
+ * the next one. Outgoing packets can be held back to simulate latency and jitter on loopback.
+ */
+class NetplayTransport
+{
+public:
+    NetplayTransport(void);
+    ~NetplayTransport(void);
+
+    // Port 0 lets the system pick a free one, which LocalPort then reports
+    bool Open(uint16_t localPort);
+    uint16_t LocalPort(void) const;
+    bool AddPeer(const char* host, uint16_t port);
+    void SetSimulatedLatency(int latencyMs, int jitterMs);
+
+    // Sends to every peer; Receive is non-blocking and returns the packet size or 0 if none is waiting
+    void Send(const uint8_t* data, size_t size);
+    size_t Receive(uint8_t* data, size_t size);
+private:
+    struct Delayed
+    {
+        uint64_t due;
+        std::vector<uint8_t> data;
+    };
+
+    void Flush(void);
+
+    int socketFd;
+    std::vector<sockaddr_in> peers;
+
+    int latencyMs;
+    int jitterMs;
+    uint32_t jitterState;
+    std::deque<Delayed> outgoing;
+};
+
+/*
+ * GGPO-style rollback session
+ *
+ * Every player's keypad is exchanged as a 16-bit mask and the machine sees the OR of all of them.
+ * Remote inputs that have not arrived yet are predicted to repeat the last known one; when a real
+ * input contradicts a prediction the session restores the snapshot taken before that frame and
+ * re-simulates up to the present.
+ */
+class RollbackSession
+{
+public:
+    // Frames we may run ahead of the slowest peer's confirmed input before stalling
+    static const int MAX_ROLLBACK = 8;
+    static const int MAX_PLAYERS = 4;
+
+    // localPlayer must be in [0, playerCount) and inputDelay at least 0; the frontend rejects
+    // anything else, and the session clamps it into range
+    RollbackSession(Chip8& machine, NetplayTransport& transport, int playerCount, int localPlayer, int inputDelay);
+
+    // Runs one frame with the given local keypad; returns false if it stalled waiting for a peer
+    bool AdvanceFrame(uint16_t localKeys);
+
+    // Exchanges inputs and rolls back if one contradicts a prediction, without running a new frame
+    void Poll(void);
+
+    // Frames every player's input has arrived for; the machine state up to there is final
+    uint32_t ConfirmedFrames(void) const;
+
+    // Estimated frames this instance is ahead of the slowest peer; the frontend idles when it is too far ahead
+    int FramesAhead(void) const;
+
+    uint32_t frame;
+    unsigned long rollbacks;
+    unsigned long resimulatedFrames;
+private:
+    static const int HISTORY = 64;
+
+    // Local inputs a peer has not acknowledged are resent in every packet, up to this many
+    static const int REDUNDANCY = 32;
+
+    void ReceiveInputs(void);
+    void SendInputs(void);
+    uint32_t Unacked(void) const;
+    uint16_t InputFor(uint32_t f);
+    void Simulate(Chip8& target, uint32_t f);
+
+    Chip8& machine;
+    NetplayTransport& transport;
+    int playerCount;
+    int localPlayer;
+    int inputDelay;
+
+    Chip8 snapshots[HISTORY];
+    uint16_t inputs[MAX_PLAYERS][HISTORY];
+    uint16_t predicted[MAX_PLAYERS][HISTORY];
+
+    // Every input before confirmed[p] has arrived; remoteFrame[p] is the frame that peer last reported
+    // running and remoteAdvantage[p] how far ahead of us it thought it was at the time
+    uint32_t confirmed[MAX_PLAYERS];
+    uint32_t remoteFrame[MAX_PLAYERS];
+    int remoteAdvantage[MAX_PLAYERS];
+    uint32_t acked[MAX_PLAYERS];
+    uint32_t rollbackTo;
+};
@@ -0,0 +1,351 @@
+#include "PredecodeEngine.h"
+
+#include <iomanip>
+#include <string.h>
+
+const double PredecodeEngine::MIN_COVERAGE = 0.01;
+
+static const int fusionLengths[PredecodeEngine::FUSION_COUNT] = {2, 2, 2, 3};
+static const char* fusionNames[PredecodeEngine::FUSION_COUNT] = {"Annn;Dxyn", "6xkk;6ykk", "Fx07;3ykk", "7xkk;3xkk;1nnn"};
+
+PredecodeEngine::PredecodeEngine()
+{
+    enabled = 0;
+    training = true;
+    machine = nullptr;
+    memset(candidates, 0, sizeof(candidates));
+    memset(fired, 0, sizeof(fired));
+    memset(saved, 0, sizeof(saved));
+    executed = 0;
+}
+
+PredecodeEngine::PredecodeEngine(unsigned fusions)
+{
+    enabled = fusions & ALL_FUSIONS;
+    training = false;
+    machine = nullptr;
+    memset(candidates, 0, sizeof(candidates));
+    memset(fired, 0, sizeof(fired));
+    memset(saved, 0, sizeof(saved));
+    executed = 0;
+}
+
+const char* PredecodeEngine::FusionName(int fusion)
+{
+    return fusion >= 0 && fusion < FUSION_COUNT ? fusionNames[fusion] : "unknown";
+}
+
+void PredecodeEngine::Reset()
+{
+    machine = nullptr;
+}
+
+void PredecodeEngine::Flush(const Chip8& chip8)
+{
+    for (int i = 0; i < 4096; i++) code[i].kind = UNDECODED;
+    for (int page = 0; page < Chip8::PAGE_COUNT; page++) decodedVersions[page] = chip8.PageVersion(page);
+    decodedMemoryVersion = chip8.MemoryVersion();
+}
+
+void PredecodeEngine::Sync(const Chip8& chip8)
+{
+    if (decodedMemoryVersion == chip8.MemoryVersion()) return;
+    decodedMemoryVersion = chip8.MemoryVersion();
+
+    // A write anywhere in a page since it was decoded drops every record in it
+    for (int page = 0; page < Chip8::PAGE_COUNT; page++)
+    {
+        if (decodedVersions[page] == chip8.PageVersion(page)) continue;
+
+        for (int i = 0; i < Chip8::PAGE_SIZE; i++) code[(page << 8) | i].kind = UNDECODED;
+        decodedVersions[page] = chip8.PageVersion(page);
+    }
+}
+
+void PredecodeEngine::Invalidate(const Chip8& chip8, uint16_t address, int count)
+{
+    // A record reads up to six bytes from its address, so any starting up to five bytes back may be stale
+    for (int i = -5; i < count; i++) code[(address + i) & 0xFFF].kind = UNDECODED;
+    for (int page = 0; page < Chip8::PAGE_COUNT; page++) decodedVersions[page] = chip8.PageVersion(page);
+    decodedMemoryVersion = chip8.MemoryVersion();
+}
+
+void PredecodeEngine::Decode(const Chip8& chip8, uint16_t address)
+{
+    Decoded& decoded = code[address];
+    uint16_t opcode = Instructions::Fetch(chip8, address);
+
+    decoded.kind = Instructions::Decode(opcode);
+    decoded.x = (opcode >> 8) & 0xF;
+    decoded.y = (opcode >> 4) & 0xF;
+    decoded.nnn = opcode & 0xFFF;
+    decoded.kk = opcode & 0xFF;
+    decoded.n = opcode & 0xF;
+    decoded.length = 1;
+    decoded.candidate = FUSION_COUNT;
+    decoded.writes = decoded.kind == Instructions::FALLBACK;
+
+    // An opcode split across two pages would go stale with either of them; leave it to Update
+    int offset = address & 0xFF;
+    if (offset == 0xFF)
+    {
+        decoded.kind = Instructions::FALLBACK;
+        decoded.writes = true;
+        return;
+    }
+
+    // Groups stay inside one page so the page version check at their first address covers them
+    if (offset + 3 > 0xFF) return;
+    uint16_t second = Instructions::Fetch(chip8, address + 2);
+    Instructions::Kind secondKind = Instructions::Decode(second);
+
+    if (decoded.kind == Instructions::LD_ANNN && secondKind == Instructions::DRW_DXYN) decoded.candidate = ANNN_DXYN;
+    else if (decoded.kind == Instructions::LD_6XKK && secondKind == Instructions::LD_6XKK) decoded.candidate = LD_6XKK_6YKK;
+    else if (decoded.kind == Instructions::LD_FX07 && secondKind == Instructions::SE_3XKK) decoded.candidate = FX07_3YKK;
+    else if (decoded.kind == Instructions::ADD_7XKK && secondKind == Instructions::SE_3XKK && offset + 5 <= 0xFF)
+    {
+        uint16_t third = Instructions::Fetch(chip8, address + 4);
+        if (Instructions::Decode(third) == Instructions::JP_1NNN)
+        {
+            decoded.candidate = ADD_7XKK_3XKK_1NNN;
+            decoded.nnn3 = third & 0xFFF;
+        }
+    }
+
+    if (decoded.candidate == FUSION_COUNT || (enabled & (1 << decoded.candidate)) == 0) return;
+
+    decoded.kind = Instructions::KIND_COUNT + decoded.candidate;
+    decoded.length = fusionLengths[decoded.candidate];
+    decoded.x2 = (second >> 8) & 0xF;
+    decoded.kk2 = second & 0xFF;
+
+    // The draw takes its operands from the second instruction; only nnn comes from Annn
+    if (decoded.candidate == ANNN_DXYN)
+    {
+        decoded.x = (second >> 8) & 0xF;
+        decoded.y = (second >> 4) & 0xF;
+        decoded.n = second & 0xF;
+    }
+}
+
+// Runs Execute with the machine's quirk profile as its template argument
+struct PredecodeEngine::Runner
+{
+    PredecodeEngine* engine;
+    Chip8* chip8;
+    long count;
+
+    template <class Q>
+    void Run(void) { engine->Execute<Q>(*chip8, count); }
+};
+
+void PredecodeEngine::Run(Chip8& chip8, long count)
+{
+    if (&chip8 != machine)
+    {
+        Flush(chip8);
+        machine = &chip8;
+    }
+
+    // Memory may have been written from outside since the last call
+    Sync(chip8);
+
+    // Records do not depend on the profile, only the handlers do
+    Runner runner = {this, &chip8, count};
+    VisitQuirks(chip8.Quirks(), chip8.Bounds(), runner);
+}
+
+template <class Q>
+void PredecodeEngine::Execute(Chip8& chip8, long count)
+{
+    // pc, the budget and the training flag live in locals so stores through V do not make the loop
+    // reload them; pc is written back around the helpers and Update calls that use it
+    uint8_t* V = Instructions::V(chip8);
+    uint16_t pc = Instructions::PC(chip8);
+    const long budget = count;
+    bool profiling = training;
+
+    while (count > 0)
+    {
+        uint16_t address = pc & 0xFFF;
+        if (code[address].kind == UNDECODED) Decode(chip8, address);
+
+        const Decoded& decoded = code[address];
+        if (profiling && decoded.candidate < FUSION_COUNT) candidates[decoded.candidate]++;
+
+        // A group that would run past the budget is split; Update runs its first instruction alone. So
+        // does an instruction that faults, as Update is what halts the machine
+        if (decoded.length > count || (Q::BOUNDS == BOUNDS_FAULT && chip8.Check(pc) != Chip8::FAULT_NONE))
+        {
+            Instructions::PC(chip8) = pc;
+            chip8.Update();
+            pc = Instructions::PC(chip8);
+            count--;
+            continue;
+        }
+
+        uint8_t x = decoded.x;
+        uint8_t y = decoded.y;
+        int done = decoded.length;
+
+        switch (decoded.kind)
+        {
+            case Instructions::CLS_00E0: Instructions::Clear(chip8); pc += 2; break;
+            case Instructions::RET_00EE: Instructions::Return(chip8); pc = Instructions::PC(chip8); break;
+            case Instructions::JP_1NNN: pc = decoded.nnn; break;
+            case Instructions::CALL_2NNN: Instructions::PC(chip8) = pc; Instructions::Call(chip8, decoded.nnn); pc = decoded.nnn; break;
+            case Instructions::SE_3XKK: pc += V[x] == decoded.kk ? 4 : 2; break;
+            case Instructions::SNE_4XKK: pc += V[x] != decoded.kk ? 4 : 2; break;
+            case Instructions::SE_5XY0: pc += V[x] == V[y] ? 4 : 2; break;
+            case Instructions::LD_6XKK: V[x] = decoded.kk; pc += 2; break;
+            case Instructions::ADD_7XKK: V[x] += decoded.kk; pc += 2; break;
+            case Instructions::LD_8XY0: V[x] = V[y]; pc += 2; break;
+            case Instructions::OR_8XY1: V[x] |= V[y]; if (Q::LOGIC_RESETS_VF) V[0xF] = 0; pc += 2; break;
+            case Instructions::AND_8XY2: V[x] &= V[y]; if (Q::LOGIC_RESETS_VF) V[0xF] = 0; pc += 2; break;
+            case Instructions::XOR_8XY3: V[x] ^= V[y]; if (Q::LOGIC_RESETS_VF) V[0xF] = 0; pc += 2; break;
+
+            // VF is written before the result, exactly as Update orders it, so x or y == F behaves the same
+            case Instructions::ADD_8XY4: V[0xF] = (int)V[x] + (int)V[y] < 256 ? 0 : 1; V[x] += V[y]; pc += 2; break;
+            case Instructions::SUB_8XY5: V[0xF] = V[x] < V[y] ? 0 : 1; V[x] -= V[y]; pc += 2; break;
+            case Instructions::SHR_8XY6: V[0xF] = V[Q::SHIFT_READS_VY ? y : x] & 0x1; V[x] = V[Q::SHIFT_READS_VY ? y : x] >> 1; pc += 2; break;
+            case Instructions::SUBN_8XY7: V[0xF] = V[y] < V[x] ? 0 : 1; V[x] = V[y] - V[x]; pc += 2; break;
+            case Instructions::SHL_8XYE: V[0xF] = V[Q::SHIFT_READS_VY ? y : x] >> 7; V[x] = V[Q::SHIFT_READS_VY ? y : x] << 1; pc += 2; break;
+
+            case Instructions::SNE_9XY0: pc += V[x] != V[y] ? 4 : 2; break;
+            case Instructions::LD_ANNN: Instructions::I(chip8) = decoded.nnn; pc += 2; break;
+            case Instructions::JP_BNNN: pc = decoded.nnn + V[Q::JUMP_USES_VX ? x : 0]; break;
+            case Instructions::RND_CXKK: V[x] = Instructions::Random(chip8) & decoded.kk; pc += 2; break;
+            case Instructions::DRW_DXYN: Instructions::Draw<Q>(chip8, x, y, decoded.n); pc += 2; break;
+            case Instructions::SKP_EX9E: pc += Instructions::KeyDown(chip8, x) ? 4 : 2; break;
+            case Instructions::SKNP_EXA1: pc += Instructions::KeyDown(chip8, x) ? 2 : 4; break;
+            case Instructions::LD_FX07: V[x] = Instructions::DelayTimer(chip8); pc += 2; break;
+            case Instructions::LD_FX0A: Instructions::PC(chip8) = pc; Instructions::WaitKey(chip8, x); pc = Instructions::PC(chip8); break;
+            case Instructions::LD_FX15: Instructions::DelayTimer(chip8) = V[x]; pc += 2; break;
+            case Instructions::LD_FX18: Instructions::SoundTimer(chip8) = V[x]; pc += 2; break;
+            case Instructions::ADD_FX1E: Instructions::I(chip8) += V[x]; pc += 2; break;
+            case Instructions::LD_FX29: Instructions::I(chip8) = 5 * V[x]; pc += 2; break;
+            case Instructions::BCD_FX33: Instructions::Bcd(chip8, x); Invalidate(chip8, Instructions::I(chip8), 3); pc += 2; break;
+            case Instructions::LD_FX55:
+            {
+                uint16_t at = Instructions::I(chip8);
+                Instructions::Store<Q>(chip8, x);
+                Invalidate(chip8, at, x + 1);
+                pc += 2;
+                break;
+            }
+            case Instructions::LD_FX65: Instructions::Load<Q>(chip8, x); pc += 2; break;
+
+            // The check above saw the old I, so a draw that faults with the new one is left to Update; the
+            // other groups hold nothing after their first instruction that can fault
+            case Instructions::KIND_COUNT + ANNN_DXYN:
+            {
+                Instructions::I(chip8) = decoded.nnn;
+                pc += 2;
+                if (Q::BOUNDS == BOUNDS_FAULT && chip8.Check(pc) != Chip8::FAULT_NONE)
+                {
+                    done = 1;
+                    break;
+                }
+                Instructions::Tick(chip8);
+                Instructions::Draw<Q>(chip8, x, y, decoded.n);
+                pc += 2;
+                fired[ANNN_DXYN]++;
+                saved[ANNN_DXYN]++;
+                break;
+            }
+
+            case Instructions::KIND_COUNT + LD_6XKK_6YKK:
+            {
+                V[x] = decoded.kk;
+                pc += 2;
+                Instructions::Tick(chip8);
+                V[decoded.x2] = decoded.kk2;
+                pc += 2;
+                fired[LD_6XKK_6YKK]++;
+                saved[LD_6XKK_6YKK]++;
+                break;
+            }
+
+            // The timer ticks between the read and the test, as it would between two Update calls
+            case Instructions::KIND_COUNT + FX07_3YKK:
+            {
+                V[x] = Instructions::DelayTimer(chip8);
+                pc += 2;
+                Instructions::Tick(chip8);
+                pc += V[decoded.x2] == decoded.kk2 ? 4 : 2;
+                fired[FX07_3YKK]++;
+                saved[FX07_3YKK]++;
+                break;
+            }
+
+            // When the test skips the jump only two instructions ran
+            case Instructions::KIND_COUNT + ADD_7XKK_3XKK_1NNN:
+            {
+                V[x] += decoded.kk;
+                pc += 2;
+                Instructions::Tick(chip8);
+                fired[ADD_7XKK_3XKK_1NNN]++;
+                if (V[decoded.x2] == decoded.kk2)
+                {
+                    pc += 4;
+                    done = 2;
+                    saved[ADD_7XKK_3XKK_1NNN]++;
+                    break;
+                }
+                pc += 2;
+                Instructions::Tick(chip8);
+                pc = decoded.nnn3;
+                saved[ADD_7XKK_3XKK_1NNN] += 2;
+                break;
+            }
+
+            // Unknown opcodes and anything else Update handles specially; Update ticks the timers itself
+            default:
+            {
+                Instructions::PC(chip8) = pc;
+                chip8.Update();
+                pc = Instructions::PC(chip8);
+                count--;
+                if (decoded.writes) Sync(chip8);
+                continue;
+            }
+        }
+
+        Instructions::Tick(chip8);
+        count -= done;
+
+        if (profiling && executed + budget - count >= TRAINING_INSTRUCTIONS)
+        {
+            long total = executed + budget - count;
+            for (int f = 0; f < FUSION_COUNT; f++)
+            {
+                if ((double)candidates[f] * fusionLengths[f] >= MIN_COVERAGE * total) enabled |= 1 << f;
+            }
+            profiling = training = false;
+            Flush(chip8);
+        }
+    }
+
+    Instructions::PC(chip8) = pc;
+    executed += budget;
+}
+
+void PredecodeEngine::WriteReport(std::ostream& out) const
+{
+    uint64_t dispatchesSaved = 0;
+
+    out << "  fusion            enabled  candidates       fired  dispatches saved\n";
+    for (int f = 0; f < FUSION_COUNT; f++)
+    {
+        out << "  " << std::left << std::setw(16) << fusionNames[f] << std::right
+            << std::setw(9) << ((enabled & (1 << f)) ? "yes" : "no")
+            << std::setw(12) << candidates[f]
+            << std::setw(12) << fired[f]
+            << std::setw(18) << saved[f] << "\n";
+        dispatchesSaved += saved[f];
+    }
+    out << "  " << dispatchesSaved << " of " << executed << " dispatches saved ("
+        << std::fixed << std::setprecision(2) << (executed > 0 ? 100.0 * dispatchesSaved / executed : 0.0)
+        << "%)\n";
+    out.unsetf(std::ios::fixed);
+}
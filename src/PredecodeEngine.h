@@ -0,0 +1,104 @@
+#pragma once
+
+#include <ostream>
+#include <stdint.h>
+
+#include "Engine.h"
+#include "Instructions.h"
+
+/*
+ * Predecoding engine with superinstruction fusion
+ *
+ * Every address is decoded once into a record of instruction kind and operands, and re-decoded
+ * when its bytes change. FX33 and FX55 drop just the records overlapping the bytes they wrote;
+ * anything else that writes (opcodes left to Update, or the machine's owner between calls) is
+ * caught by comparing page versions after it and on entry to Run, never per fetch.
+ *
+ * A fusion pass can replace a frequent sequence starting at an address with one fused record, so
+ * dispatch runs once for the whole group:
+ *
+ *   Annn; Dxyn           set I and draw
+ *   6xkk; 6ykk           two immediate loads
+ *   Fx07; 3ykk           read the delay timer and test it
+ *   7xkk; 3xkk; 1nnn     counted loop step: add, test, jump back unless done
+ *
+ * By default the engine profiles the first TRAINING_INSTRUCTIONS it runs, counting how often each
+ * sequence starts an executed instruction, and enables the fusions that cover at least
+ * MIN_COVERAGE of them. Fused handlers still tick the timers after every instruction they cover,
+ * and a group that does not fit in the remaining budget runs one instruction at a time.
+ */
+class PredecodeEngine : public Engine
+{
+public:
+    enum Fusion
+    {
+        ANNN_DXYN,
+        LD_6XKK_6YKK,
+        FX07_3YKK,
+        ADD_7XKK_3XKK_1NNN,
+        FUSION_COUNT
+    };
+
+    static const unsigned ALL_FUSIONS = (1 << FUSION_COUNT) - 1;
+    static const long TRAINING_INSTRUCTIONS = 100000;
+    static const double MIN_COVERAGE;
+
+    // Profile-guided selection by default; pass a mask of (1 << Fusion) bits to force a set
+    PredecodeEngine(void);
+    explicit PredecodeEngine(unsigned fusions);
+
+    void Run(Chip8& chip8, long count);
+    void Reset(void);
+    void WriteReport(std::ostream& out) const;
+
+    static const char* FusionName(int fusion);
+
+    unsigned enabled;
+    uint64_t candidates[FUSION_COUNT];
+    uint64_t fired[FUSION_COUNT];
+    uint64_t saved[FUSION_COUNT];
+    uint64_t executed;
+private:
+    // One record per address; `length` is the number of instructions a fused record covers. Padded
+    // to 16 bytes so indexing is a shift
+    struct alignas(16) Decoded
+    {
+        uint8_t kind;
+        uint8_t x;
+        uint8_t y;
+        uint8_t length;
+        uint16_t nnn;
+        uint8_t kk;
+        uint8_t n;
+
+        // Operands of the second and third instructions of a fused record
+        uint8_t x2;
+        uint8_t kk2;
+        uint16_t nnn3;
+
+        // Fusion this address would start if it were enabled, or FUSION_COUNT
+        uint8_t candidate;
+
+        // Set for opcodes left to Update, which may write anywhere; decoded pages are revalidated after them
+        bool writes;
+    };
+
+    static const int UNDECODED = 0xFF;
+
+    struct Runner;
+
+    // The run loop for one quirk profile
+    template <class Q>
+    void Execute(Chip8& chip8, long count);
+
+    void Flush(const Chip8& chip8);
+    void Sync(const Chip8& chip8);
+    void Invalidate(const Chip8& chip8, uint16_t address, int count);
+    void Decode(const Chip8& chip8, uint16_t address);
+
+    Decoded code[4096];
+    uint32_t decodedVersions[Chip8::PAGE_COUNT];
+    uint32_t decodedMemoryVersion;
+    const Chip8* machine;
+    bool training;
+};
@@ -0,0 +1,30 @@
+#pragma once
+
+/*
+ * USDT tracepoints under the "chip8" provider, for bpftrace, perf and SystemTap:
+ *
+ *   instruction(pc, opcode)     every instruction the interpreter dispatches
+ *   draw(x, y, rows, collision) every Dxyn
+ *   frame()                     end of every RunFrame
+ *   timer_tick(delay, sound)    every timer decrement
+ *   key(index, pressed)         keypad changes seen by the frontend
+ *   rom_load(path, size)        every ROM loaded; path is null for in-memory ROMs
+ *
+ * e.g. bpftrace -e 'usdt:./Chip8:chip8:instruction { @[arg1 >> 12] = count(); }' -p <pid>
+ *
+ * A probe is a single nop plus an ELF note until a tracer attaches, and needs nothing at runtime.
+ * Builds without <sys/sdt.h>, or with CHIP8_USDT off, compile them out.
+ */
+#ifdef CHIP8_USDT
+#include <sys/sdt.h>
+
+#define CHIP8_PROBE0(name) DTRACE_PROBE(chip8, name)
+#define CHIP8_PROBE1(name, a) DTRACE_PROBE1(chip8, name, a)
+#define CHIP8_PROBE2(name, a, b) DTRACE_PROBE2(chip8, name, a, b)
+#define CHIP8_PROBE4(name, a, b, c, d) DTRACE_PROBE4(chip8, name, a, b, c, d)
+#else
+#define CHIP8_PROBE0(name)
+#define CHIP8_PROBE1(name, a)
+#define CHIP8_PROBE2(name, a, b)
+#define CHIP8_PROBE4(name, a, b, c, d)
+#endif
@@ -0,0 +1,187 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <iomanip>
+
+static const char* classNames[Profiler::CLASS_COUNT] =
+{
+        "00E0", "00EE", "0nnn", "1nnn", "2nnn", "3xkk", "4xkk", "5xy0", "6xkk", "7xkk",
+        "8xy0", "8xy1", "8xy2", "8xy3", "8xy4", "8xy5", "8xy6", "8xy7", "8xyE", "9xy0",
+        "Annn", "Bnnn", "Cxkk", "Dxyn", "Ex9E", "ExA1", "Fx07", "Fx0A", "Fx15", "Fx18",
+        "Fx1E", "Fx29", "Fx33", "Fx55", "Fx65", "unknown"
+};
+
+int Profiler::Classify(uint16_t opcode)
+{
+    static const int unknown = CLASS_COUNT - 1;
+
+    switch (opcode >> 12)
+    {
+        // The core only looks at the low byte, as Instructions::Decode does
+        case 0x0:
+            if ((opcode & 0xFF) == 0xE0) return 0;
+            if ((opcode & 0xFF) == 0xEE) return 1;
+            return 2;
+        // The core ignores the low nibble of 5xy0 and 9xy0
+        case 0x5:
+            return 7;
+        case 0x9:
+            return 19;
+        case 0x8:
+        {
+            int n = opcode & 0xF;
+            if (n <= 7) return 10 + n;
+            return n == 0xE ? 18 : unknown;
+        }
+        case 0xE:
+            if ((opcode & 0xFF) == 0x9E) return 24;
+            if ((opcode & 0xFF) == 0xA1) return 25;
+            return unknown;
+        case 0xF:
+            switch (opcode & 0xFF)
+            {
+                case 0x07: return 26;
+                case 0x0A: return 27;
+                case 0x15: return 28;
+                case 0x18: return 29;
+                case 0x1E: return 30;
+                case 0x29: return 31;
+                case 0x33: return 32;
+                case 0x55: return 33;
+                case 0x65: return 34;
+                default: return unknown;
+            }
+        default:
+        {
+            // 1nnn..4xkk, 6xkk, 7xkk, Annn..Dxyn map straight from the high nibble
+            static const int direct[16] = {0, 3, 4, 5, 6, 0, 8, 9, 0, 0, 20, 21, 22, 23, 0, 0};
+            return direct[opcode >> 12];
+        }
+    }
+}
+
+const char* Profiler::ClassName(int opcodeClass)
+{
+    return classNames[opcodeClass];
+}
+
+Profiler::Profiler()
+{
+    for (int i = 0; i < CLASS_COUNT; i++) classCounts[i] = 0;
+    for (int i = 0; i < 4096; i++) pcCounts[i] = 0;
+    lastEvent = std::chrono::steady_clock::now();
+    running = false;
+}
+
+// Host time since the previous event belongs to whatever subroutine was running, if the machine was
+void Profiler::Attribute()
+{
+    if (!running) return;
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    selfTime[callStack] += std::chrono::duration_cast<std::chrono::nanoseconds>(now - lastEvent).count();
+    lastEvent = now;
+}
+
+void Profiler::Resume()
+{
+    lastEvent = std::chrono::steady_clock::now();
+    running = true;
+}
+
+void Profiler::Pause()
+{
+    Attribute();
+    running = false;
+}
+
+void Profiler::Call(uint16_t target)
+{
+    Attribute();
+
+    // The core's stack wraps, so a call past its depth overwrites the oldest return address
+    if (callStack.size() == MAX_DEPTH) callStack.erase(callStack.begin());
+    callStack.push_back(target);
+    calls[target]++;
+}
+
+void Profiler::Return()
+{
+    Attribute();
+    if (!callStack.empty()) callStack.pop_back();
+}
+
+void Profiler::WriteReport(std::ostream& out)
+{
+    Attribute();
+
+    uint64_t total = 0;
+    std::vector<std::pair<uint64_t, int> > classes;
+    for (int i = 0; i < CLASS_COUNT; i++)
+    {
+        total += classCounts[i];
+        if (classCounts[i] > 0) classes.push_back(std::make_pair(classCounts[i], i));
+    }
+    std::sort(classes.rbegin(), classes.rend());
+
+    out << "Opcode classes (" << total << " instructions)\n";
+    for (size_t i = 0; i < classes.size(); i++)
+    {
+        out << "  " << std::setw(8) << std::left << classNames[classes[i].second] << std::right
+            << std::setw(14) << classes[i].first << std::setw(9) << std::fixed << std::setprecision(2)
+            << 100.0 * classes[i].first / total << "%\n";
+    }
+
+    std::vector<std::pair<uint64_t, int> > addresses;
+    for (int i = 0; i < 4096; i++)
+    {
+        if (pcCounts[i] > 0) addresses.push_back(std::make_pair(pcCounts[i], i));
+    }
+    std::sort(addresses.rbegin(), addresses.rend());
+
+    out << "\nHot addresses\n";
+    for (size_t i = 0; i < addresses.size() && i < 32; i++)
+    {
+        out << "  0x" << std::hex << std::setw(3) << std::setfill('0') << addresses[i].second << std::dec
+            << std::setfill(' ') << std::setw(14) << addresses[i].first << std::setw(9)
+            << 100.0 * addresses[i].first / total << "%\n";
+    }
+
+    // Self time per subroutine summed over every path it appears on; the empty path is top level
+    std::map<int, uint64_t> self;
+    for (std::map<std::vector<uint16_t>, uint64_t>::iterator it = selfTime.begin(); it != selfTime.end(); ++it)
+    {
+        self[it->first.empty() ? -1 : it->first.back()] += it->second;
+    }
+
+    std::vector<std::pair<uint64_t, int> > subroutines;
+    for (std::map<int, uint64_t>::iterator it = self.begin(); it != self.end(); ++it)
+    {
+        subroutines.push_back(std::make_pair(it->second, it->first));
+    }
+    std::sort(subroutines.rbegin(), subroutines.rend());
+
+    out << "\nSubroutines by self time\n";
+    for (size_t i = 0; i < subroutines.size(); i++)
+    {
+        if (subroutines[i].second < 0) out << "  main ";
+        else out << "  0x" << std::hex << std::setw(3) << std::setfill('0') << subroutines[i].second << std::dec << std::setfill(' ');
+        out << std::setw(14) << subroutines[i].first / 1000 << " us";
+        if (subroutines[i].second >= 0) out << std::setw(12) << calls[subroutines[i].second] << " calls";
+        out << "\n";
+    }
+}
+
+void Profiler::WriteFoldedStacks(std::ostream& out)
+{
+    Attribute();
+
+    for (std::map<std::vector<uint16_t>, uint64_t>::iterator it = selfTime.begin(); it != selfTime.end(); ++it)
+    {
+        if (it->second == 0) continue;
+
+        out << "main";
+        for (size_t i = 0; i < it->first.size(); i++) out << ";sub_0x" << std::hex << it->first[i] << std::dec;
+        out << " " << it->second << "\n";
+    }
+}
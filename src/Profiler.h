@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <ostream>
+#include <stdint.h>
+#include <vector>
+
+/*
+ * Execution profile of a running ROM
+ *
+ * Counts executions per opcode class and per address, and attributes host time to the emulated
+ * call stack as tracked through 2nnn/00EE. Only time between Resume and Pause is attributed, which
+ * the core brackets Update and RunFrame with, so the frontend's rendering and sleeping are not
+ * charged to whatever subroutine was running. The core only calls into it when built with
+ * CHIP8_PROFILE, so normal builds carry no hooks at all.
+ */
+class Profiler
+{
+public:
+    // One class per distinct instruction form: 00E0, 00EE, 1nnn, ..., 8xy0 ... 8xyE, ..., Fx65
+    static const int CLASS_COUNT = 36;
+    static int Classify(uint16_t opcode);
+    static const char* ClassName(int opcodeClass);
+
+    Profiler(void);
+
+    void Instruction(uint16_t pc, uint16_t opcode)
+    {
+        classCounts[Classify(opcode)]++;
+        pcCounts[pc & 0xFFF]++;
+    }
+    void Call(uint16_t target);
+    void Return(void);
+
+    // Start and stop attributing host time to the call stack
+    void Resume(void);
+    void Pause(void);
+
+    // Opcode classes, hot addresses and subroutines, most expensive first
+    void WriteReport(std::ostream& out);
+
+    // One "main;sub_0x2a4;sub_0x31c <ns>" line per call path, for flamegraph.pl and friends
+    void WriteFoldedStacks(std::ostream& out);
+
+    uint64_t classCounts[CLASS_COUNT];
+    uint64_t pcCounts[4096];
+private:
+    void Attribute(void);
+
+    // Depth of the core's stack; deeper call paths keep only their innermost frames, which bounds
+    // the number of distinct paths selfTime can hold
+    static const size_t MAX_DEPTH = 16;
+
+    std::vector<uint16_t> callStack;
+    std::map<std::vector<uint16_t>, uint64_t> selfTime;
+    std::map<uint16_t, uint64_t> calls;
+    std::chrono::steady_clock::time_point lastEvent;
+    bool running;
+};
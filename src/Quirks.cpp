@@ -0,0 +1,43 @@
+#include "Quirks.h"
+
+static const char* const PROFILE_NAMES[QUIRK_PROFILE_COUNT] = {"default", "vip", "chip48", "schip", "xochip"};
+
+const char* QuirkProfileName(QuirkProfile profile)
+{
+    if (profile < 0 || profile >= QUIRK_PROFILE_COUNT) return "unknown";
+    return PROFILE_NAMES[profile];
+}
+
+bool ParseQuirkProfile(const std::string& name, QuirkProfile& profile)
+{
+    for (int i = 0; i < QUIRK_PROFILE_COUNT; i++)
+    {
+        if (name == PROFILE_NAMES[i])
+        {
+            profile = (QuirkProfile)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static const char* const BOUNDS_NAMES[BOUNDS_MODE_COUNT] = {"wrap", "fault"};
+
+const char* BoundsModeName(BoundsMode mode)
+{
+    if (mode < 0 || mode >= BOUNDS_MODE_COUNT) return "unknown";
+    return BOUNDS_NAMES[mode];
+}
+
+bool ParseBoundsMode(const std::string& name, BoundsMode& mode)
+{
+    for (int i = 0; i < BOUNDS_MODE_COUNT; i++)
+    {
+        if (name == BOUNDS_NAMES[i])
+        {
+            mode = (BoundsMode)i;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <string>
+
+/*
+ * CHIP-8 quirk profiles
+ *
+ * Interpreters disagree on a handful of instructions. Each profile is a type whose constants the
+ * core and the engines read as template arguments, so choosing a profile picks a specialization
+ * once instead of testing a flag on every instruction.
+ *
+ *   SHIFT_READS_VY   8xy6/8xyE shift Vy into Vx instead of shifting Vx in place
+ *   INDEX_ADVANCE    how far FX55/FX65 move I: not at all, by x, or by x + 1
+ *   JUMP_USES_VX     Bnnn jumps to nnn + Vx, x being the top nibble of nnn, instead of nnn + V0
+ *   SPRITES_CLIP     sprites start at a wrapped position but are cut off at the screen edges
+ *   LOGIC_RESETS_VF  8xy1/8xy2/8xy3 clear VF
+ *
+ * QUIRKS_DEFAULT is what this emulator has always done; the named profiles follow the usual
+ * descriptions of those platforms.
+ */
+enum QuirkProfile
+{
+    QUIRKS_DEFAULT,
+    QUIRKS_COSMAC_VIP,
+    QUIRKS_CHIP48,
+    QUIRKS_SCHIP,
+    QUIRKS_XO_CHIP,
+    QUIRK_PROFILE_COUNT
+};
+
+enum IndexAdvance
+{
+    INDEX_UNCHANGED,
+    INDEX_BY_X,
+    INDEX_BY_X_PLUS_ONE
+};
+
+struct DefaultQuirks
+{
+    static const bool SHIFT_READS_VY = false;
+    static const IndexAdvance INDEX_ADVANCE = INDEX_UNCHANGED;
+    static const bool JUMP_USES_VX = false;
+    static const bool SPRITES_CLIP = false;
+    static const bool LOGIC_RESETS_VF = false;
+};
+
+struct CosmacVipQuirks
+{
+    static const bool SHIFT_READS_VY = true;
+    static const IndexAdvance INDEX_ADVANCE = INDEX_BY_X_PLUS_ONE;
+    static const bool JUMP_USES_VX = false;
+    static const bool SPRITES_CLIP = true;
+    static const bool LOGIC_RESETS_VF = true;
+};
+
+struct Chip48Quirks
+{
+    static const bool SHIFT_READS_VY = false;
+    static const IndexAdvance INDEX_ADVANCE = INDEX_BY_X;
+    static const bool JUMP_USES_VX = true;
+    static const bool SPRITES_CLIP = true;
+    static const bool LOGIC_RESETS_VF = false;
+};
+
+struct SchipQuirks
+{
+    static const bool SHIFT_READS_VY = false;
+    static const IndexAdvance INDEX_ADVANCE = INDEX_UNCHANGED;
+    static const bool JUMP_USES_VX = true;
+    static const bool SPRITES_CLIP = true;
+    static const bool LOGIC_RESETS_VF = false;
+};
+
+struct XoChipQuirks
+{
+    static const bool SHIFT_READS_VY = true;
+    static const IndexAdvance INDEX_ADVANCE = INDEX_BY_X_PLUS_ONE;
+    static const bool JUMP_USES_VX = false;
+    static const bool SPRITES_CLIP = false;
+    static const bool LOGIC_RESETS_VF = false;
+};
+
+/*
+ * What happens when an instruction reaches outside the machine: a fetch or data access past 0xFFF,
+ * a call with all 16 stack entries in use, a return with none, or a key index above 0xF.
+ *
+ *   BOUNDS_WRAP   addresses wrap at 4KB, the stack at 16 entries and key indices at 16; masking
+ *                 alone keeps every access in range, so this costs no branches
+ *   BOUNDS_FAULT  the offending instruction does not run and the machine halts with a Chip8::Fault
+ */
+enum BoundsMode
+{
+    BOUNDS_WRAP,
+    BOUNDS_FAULT,
+    BOUNDS_MODE_COUNT
+};
+
+// A quirk profile together with a bounds mode; this is the type the core and engines are instantiated on
+template <class Profile, BoundsMode MODE>
+struct Bounded : Profile
+{
+    static const BoundsMode BOUNDS = MODE;
+};
+
+// How far FX55/FX65 with register count x + 1 move I under profile Q
+template <class Q>
+inline int IndexStep(int x)
+{
+    return Q::INDEX_ADVANCE == INDEX_BY_X ? x : Q::INDEX_ADVANCE == INDEX_BY_X_PLUS_ONE ? x + 1 : 0;
+}
+
+// Short names used on command lines: default, vip, chip48, schip, xochip
+const char* QuirkProfileName(QuirkProfile profile);
+
+// Returns false for an unknown name
+bool ParseQuirkProfile(const std::string& name, QuirkProfile& profile);
+
+// wrap or fault
+const char* BoundsModeName(BoundsMode mode);
+bool ParseBoundsMode(const std::string& name, BoundsMode& mode);
+
+template <class Profile, class Visitor>
+void VisitBounds(BoundsMode bounds, Visitor& visitor)
+{
+    if (bounds == BOUNDS_FAULT) visitor.template Run<Bounded<Profile, BOUNDS_FAULT>>();
+    else visitor.template Run<Bounded<Profile, BOUNDS_WRAP>>();
+}
+
+/*
+ * Calls visitor.template Run<Q>() with the type for `profile` and `bounds`, which is how a runtime
+ * choice becomes a template argument. Visitor is a small struct holding the call's arguments.
+ */
+template <class Visitor>
+void VisitQuirks(QuirkProfile profile, BoundsMode bounds, Visitor& visitor)
+{
+    switch (profile)
+    {
+        case QUIRKS_COSMAC_VIP: VisitBounds<CosmacVipQuirks>(bounds, visitor); break;
+        case QUIRKS_CHIP48: VisitBounds<Chip48Quirks>(bounds, visitor); break;
+        case QUIRKS_SCHIP: VisitBounds<SchipQuirks>(bounds, visitor); break;
+        case QUIRKS_XO_CHIP: VisitBounds<XoChipQuirks>(bounds, visitor); break;
+        default: VisitBounds<DefaultQuirks>(bounds, visitor); break;
+    }
+}
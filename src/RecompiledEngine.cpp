@@ -0,0 +1,168 @@
+#include "RecompiledEngine.h"
+
+#include <iomanip>
+
+#include "Instructions.h"
+
+RecompiledEngine::RecompiledEngine()
+{
+    executed = 0;
+    interpreted = 0;
+    rechecked = 0;
+    program = nullptr;
+    machine = nullptr;
+}
+
+void RecompiledEngine::Reset()
+{
+    machine = nullptr;
+}
+
+// A function-local static, so registering from other files' static initializers is safe
+std::vector<const RecompiledProgram*>& RecompiledEngine::Registered()
+{
+    static std::vector<const RecompiledProgram*> programs;
+    return programs;
+}
+
+void RecompiledEngine::Register(const RecompiledProgram* program)
+{
+    Registered().push_back(program);
+}
+
+const std::vector<const RecompiledProgram*>& RecompiledEngine::Programs()
+{
+    return Registered();
+}
+
+bool RecompiledEngine::Matches(const Chip8& chip8, const RecompiledProgram& program, uint16_t address, int length)
+{
+    const uint8_t* bytes = program.image + (address - program.origin);
+    for (int i = 0; i < 2 * length; i++)
+    {
+        if (chip8.Read(address + i) != bytes[i]) return false;
+    }
+    return true;
+}
+
+void RecompiledEngine::Select(const Chip8& chip8)
+{
+    // Memory may already differ from every image in places, so pick by blocks rather than bytes
+    const std::vector<const RecompiledProgram*>& programs = Programs();
+    program = nullptr;
+    int best = 0;
+    for (size_t p = 0; p < programs.size(); p++)
+    {
+        const RecompiledProgram& candidate = *programs[p];
+        int matching = 0;
+        for (int i = 0; i < candidate.blockCount; i++)
+        {
+            matching += Matches(chip8, candidate, candidate.blocks[i].address, candidate.blocks[i].length);
+        }
+        if (matching <= best) continue;
+
+        program = &candidate;
+        best = matching;
+    }
+
+    for (int page = 0; page < Chip8::PAGE_COUNT; page++)
+    {
+        pageBlocks[page].clear();
+
+        // Every page counts as changed, so the first Sync checks everything
+        checkedVersions[page] = chip8.PageVersion(page) - 1;
+    }
+    checkedMemoryVersion = chip8.MemoryVersion() - 1;
+    if (program == nullptr) return;
+
+    validBlocks.assign(program->blockCount, 0);
+    for (int i = 0; i < program->blockCount; i++)
+    {
+        const RecompiledBlock& block = program->blocks[i];
+        for (int page = block.address >> 8; page <= (block.address + 2 * block.length - 1) >> 8; page++)
+        {
+            pageBlocks[page].push_back(i);
+        }
+    }
+}
+
+void RecompiledEngine::Sync(const Chip8& chip8)
+{
+    if (checkedMemoryVersion == chip8.MemoryVersion()) return;
+    checkedMemoryVersion = chip8.MemoryVersion();
+
+    // Writes to pages without code, such as sprite and score data, cost nothing beyond this check
+    for (int page = 0; page < Chip8::PAGE_COUNT; page++)
+    {
+        if (checkedVersions[page] == chip8.PageVersion(page)) continue;
+        checkedVersions[page] = chip8.PageVersion(page);
+
+        const std::vector<int>& blocks = pageBlocks[page];
+        for (size_t i = 0; i < blocks.size(); i++)
+        {
+            const RecompiledBlock& block = program->blocks[blocks[i]];
+            validBlocks[blocks[i]] = Matches(chip8, *program, block.address, block.length);
+        }
+        rechecked++;
+    }
+}
+
+void RecompiledEngine::Run(Chip8& chip8, long count)
+{
+    if (&chip8 != machine)
+    {
+        Select(chip8);
+        machine = &chip8;
+    }
+    executed += count;
+
+    if (program == nullptr || chip8.Quirks() != program->quirks || chip8.Bounds() != BOUNDS_WRAP)
+    {
+        for (long i = 0; i < count; i++) chip8.Update();
+        interpreted += count;
+        return;
+    }
+
+    uint16_t pc = Instructions::PC(chip8);
+    while (count > 0)
+    {
+        // Memory may have been written from outside, by a block's FX33 or FX55, or by Update
+        Sync(chip8);
+
+        long left = program->run(chip8, pc, count, &validBlocks[0]);
+        if (left != count)
+        {
+            count = left;
+            continue;
+        }
+
+        // pc has no valid generated code; pc past 0xFFF fetches through the wrap but is a
+        // different state, so it never has any
+        Instructions::PC(chip8) = pc;
+        chip8.Update();
+        pc = Instructions::PC(chip8);
+        interpreted++;
+        count--;
+    }
+
+    Instructions::PC(chip8) = pc;
+}
+
+void RecompiledEngine::WriteReport(std::ostream& out) const
+{
+    if (program == nullptr)
+    {
+        out << "  no recompiled program for this ROM; " << executed << " instructions run by Update\n";
+        return;
+    }
+
+    uint64_t compiled = executed - interpreted;
+    int instructions = 0;
+    for (int i = 0; i < program->blockCount; i++) instructions += program->blocks[i].length;
+
+    out << "  program " << program->name << ": " << program->blockCount << " blocks, " << instructions << " instructions\n"
+        << "  " << compiled << " of " << executed << " instructions in generated code ("
+        << std::fixed << std::setprecision(2) << (executed > 0 ? 100.0 * compiled / executed : 0.0) << "%), "
+        << rechecked << " page rechecks\n";
+    out.unsetf(std::ios::fixed);
+}
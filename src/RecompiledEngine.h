@@ -0,0 +1,91 @@
+#pragma once
+
+#include <ostream>
+#include <stdint.h>
+#include <vector>
+
+#include "Engine.h"
+
+/*
+ * Engine running ROMs translated to C++ ahead of time
+ *
+ * chip8_recompile turns a ROM into one C++ function per block of its control-flow graph (see
+ * Analysis.h) and one per instruction, all inlined into a run function that goes from block to
+ * block by direct jumps wherever the next pc is known statically. The chip8_recompile_roms CMake
+ * function compiles the results into an executable, where each generated file registers its
+ * program on startup.
+ *
+ * On the first call for a machine the engine picks the registered program with the most blocks
+ * matching the machine's memory. Generated code only runs while the bytes it was translated from
+ * are unchanged: every change to memory re-checks the code covering the pages that changed, so
+ * code the ROM rewrites goes back to Update until its original bytes return. Blocks run whole
+ * while the budget covers them and one instruction at a time where it ends inside them, so frame
+ * boundaries stay in generated code. Anything without generated code (unresolved Bnnn targets,
+ * code written at run time, unknown opcodes) runs through Update.
+ *
+ * Programs are translated for one quirk profile under BOUNDS_WRAP; a machine set up any other way
+ * runs through Update entirely, as does one no program matches.
+ */
+struct RecompiledBlock
+{
+    uint16_t address;
+
+    // Instructions in the block, which covers bytes [address, address + 2 * length)
+    uint16_t length;
+};
+
+struct RecompiledProgram
+{
+    const char* name;
+
+    // The ROM as translated, loaded at origin
+    const uint8_t* image;
+    uint16_t size;
+    uint16_t origin;
+    QuirkProfile quirks;
+
+    const RecompiledBlock* blocks;
+    int blockCount;
+
+    /*
+     * Runs from pc, entering no block whose entry in `valid` (indexed like `blocks`) is clear,
+     * until the budget runs out, pc has no valid generated code or an instruction has stored to
+     * memory that may hold code. Updates pc and returns the budget left.
+     */
+    long (*run)(Chip8& chip8, uint16_t& pc, long count, const uint8_t* valid);
+};
+
+class RecompiledEngine : public Engine
+{
+public:
+    RecompiledEngine(void);
+
+    void Run(Chip8& chip8, long count);
+    void Reset(void);
+    void WriteReport(std::ostream& out) const;
+
+    // Called by the generated code's static initializers
+    static void Register(const RecompiledProgram* program);
+
+    static const std::vector<const RecompiledProgram*>& Programs(void);
+
+    uint64_t executed;
+    uint64_t interpreted;
+    uint64_t rechecked;
+private:
+    static std::vector<const RecompiledProgram*>& Registered(void);
+
+    void Select(const Chip8& chip8);
+    void Sync(const Chip8& chip8);
+    static bool Matches(const Chip8& chip8, const RecompiledProgram& program, uint16_t address, int length);
+
+    const RecompiledProgram* program;
+    std::vector<uint8_t> validBlocks;
+
+    // Indices of the blocks whose bytes lie at least partly in each page
+    std::vector<int> pageBlocks[Chip8::PAGE_COUNT];
+
+    uint32_t checkedVersions[Chip8::PAGE_COUNT];
+    uint32_t checkedMemoryVersion;
+    const Chip8* machine;
+};
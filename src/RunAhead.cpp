@@ -0,0 +1,97 @@
+#include "RunAhead.h"
+
+RunAhead::RunAhead(int threadCount)
+{
+    hits = 0;
+    misses = 0;
+    generation = 0;
+    nextCandidate = CANDIDATES;
+    stopping = false;
+
+    for (int i = 0; i < CANDIDATES; i++) ready[i] = 0;
+    if (threadCount < 1) threadCount = 1;
+    for (int i = 0; i < threadCount; i++) workers.push_back(std::thread(&RunAhead::Work, this));
+}
+
+RunAhead::~RunAhead()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+}
+
+void RunAhead::Speculate(const Chip8& snapshot)
+{
+    // The frontend clears drawFlag once it has presented, which it does after this call; the
+    // adopted frame has to report only its own draws, as one emulated directly would
+    Chip8 next = snapshot.Clone();
+    next.drawFlag = false;
+
+    // Frames still in flight belong to the previous round and are dropped when they finish, so
+    // this never waits on a worker, only on another thread copying a machine under the lock
+    std::unique_lock<std::mutex> lock(mutex);
+    base = next;
+    generation++;
+    nextCandidate = 0;
+    lock.unlock();
+
+    wake.notify_all();
+}
+
+bool RunAhead::Take(const uint8_t key[16], Chip8& out)
+{
+    int candidate = -1;
+    int toggled = 0;
+
+    // Candidate 0 is the keypad as it was; candidate k + 1 has key k toggled
+    for (int i = 0; i < 16; i++)
+    {
+        if ((key[i] != 0) != (base.key[i] != 0))
+        {
+            toggled++;
+            candidate = i + 1;
+        }
+    }
+    if (toggled == 0) candidate = 0;
+
+    if (generation == 0 || toggled > 1 || ready[candidate].load(std::memory_order_acquire) != generation)
+    {
+        misses++;
+        return false;
+    }
+
+    out.Restore(results[candidate]);
+    hits++;
+    return true;
+}
+
+void RunAhead::Work()
+{
+    Chip8 frame;
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true)
+    {
+        wake.wait(lock, [this] { return stopping || nextCandidate < CANDIDATES; });
+        if (stopping) return;
+
+        int candidate = nextCandidate++;
+        unsigned gen = generation;
+        frame = base;
+        lock.unlock();
+
+        if (candidate > 0) frame.key[candidate - 1] ^= 1;
+        frame.RunFrame();
+
+        // Speculate may have started another round meanwhile; a result for an older one is stale.
+        // Take only reads results[] between rounds, on the thread that calls Speculate
+        lock.lock();
+        if (gen != generation) continue;
+        results[candidate] = frame;
+        ready[candidate].store(gen, std::memory_order_release);
+    }
+}
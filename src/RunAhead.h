@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Chip8.h"
+
+/*
+ * Speculative run-ahead
+ *
+ * Worker threads emulate the next frame from a snapshot of the machine once for every keypad
+ * state the player is likely to produce: the current one, and the current one with a single key
+ * toggled. When the real input for the frame is known the frontend adopts the matching result
+ * instead of emulating the frame itself. Workers run on clones, so nothing attached to the machine
+ * sees the speculative frames.
+ */
+class RunAhead
+{
+public:
+    // Current keypad plus each of the 16 single-key toggles
+    static const int CANDIDATES = 17;
+
+    RunAhead(int threadCount);
+    ~RunAhead(void);
+
+    // Start emulating the frame after `base` for every candidate keypad state, with drawFlag
+    // cleared as the frontend leaves it after presenting. Does not wait for the previous round
+    void Speculate(const Chip8& base);
+
+    // Adopt the precomputed frame matching `key`; returns false if there is none ready
+    bool Take(const uint8_t key[16], Chip8& out);
+
+    unsigned long hits;
+    unsigned long misses;
+private:
+    void Work(void);
+
+    Chip8 results[CANDIDATES];
+    std::atomic<unsigned> ready[CANDIDATES];
+
+    Chip8 base;
+    unsigned generation;
+    int nextCandidate;
+    bool stopping;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<std::thread> workers;
+};
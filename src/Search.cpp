@@ -0,0 +1,180 @@
+#include "Search.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_set>
+
+// Hashes of visited states, split into shards so workers rarely wait on each other
+class ConcurrentHashSet
+{
+public:
+    // Returns true if the hash was not in the set yet
+    bool Insert(uint64_t hash)
+    {
+        Shard& shard = shards[(hash >> 58) & (SHARDS - 1)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.hashes.insert(hash).second;
+    }
+private:
+    static const int SHARDS = 64;
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unordered_set<uint64_t> hashes;
+    };
+
+    Shard shards[SHARDS];
+};
+
+StateSearch::StateSearch(int threads)
+{
+    mode = BREADTH_FIRST;
+    maxStates = 200000;
+    expanded = 0;
+    duplicates = 0;
+    threadCount = threads < 1 ? 1 : threads;
+}
+
+bool StateSearch::Run(const Chip8& start, const Goal& goal, std::vector<int>& inputs)
+{
+    // Open states ordered by score, then by creation so ties behave like a queue
+    typedef std::pair<int, int> Entry;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > open;
+
+    std::vector<Node> nodes;
+    ConcurrentHashSet visited;
+
+    nodes.push_back(Node());
+    nodes[0].state.reset(new Chip8(start.Clone()));
+    nodes[0].parent = -1;
+    nodes[0].input = NO_KEY;
+    nodes[0].depth = 0;
+    visited.Insert(start.StateHash());
+    open.push(Entry(0, 0));
+
+    expanded = 0;
+    duplicates = 0;
+    int found = goal(start) ? 0 : -1;
+    const size_t batchSize = 256 * threadCount;
+
+    // Workers are started once and woken for each round; each expands whole parents and keeps its
+    // children until the round is merged, which happens while they wait
+    std::vector<int> batch;
+    std::vector<std::vector<Node> > children(threadCount);
+    std::atomic<size_t> next(0);
+    std::atomic<size_t> dropped(0);
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    unsigned round = 0;
+    int working = 0;
+    bool stopping = false;
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threadCount; t++)
+    {
+        workers.push_back(std::thread([&, t]() {
+            unsigned seen = 0;
+            std::unique_lock<std::mutex> lock(mutex);
+
+            while (true)
+            {
+                wake.wait(lock, [&] { return stopping || round != seen; });
+                if (stopping) return;
+                seen = round;
+                lock.unlock();
+
+                size_t i;
+                while ((i = next++) < batch.size())
+                {
+                    const Node& parent = nodes[batch[i]];
+
+                    for (int input = NO_KEY; input < 16; input++)
+                    {
+                        Node child;
+                        child.state.reset(new Chip8(parent.state->Clone()));
+                        for (int k = 0; k < 16; k++) child.state->key[k] = k == input;
+                        child.state->RunFrame();
+
+                        if (!visited.Insert(child.state->StateHash()))
+                        {
+                            dropped++;
+                            continue;
+                        }
+
+                        child.parent = batch[i];
+                        child.input = input;
+                        child.depth = parent.depth + 1;
+                        children[t].push_back(std::move(child));
+                    }
+                }
+
+                lock.lock();
+                if (--working == 0) idle.notify_one();
+            }
+        }));
+    }
+
+    while (found < 0 && !open.empty() && nodes.size() < maxStates)
+    {
+        batch.clear();
+        while (!open.empty() && batch.size() < batchSize)
+        {
+            batch.push_back(open.top().second);
+            open.pop();
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (int t = 0; t < threadCount; t++) children[t].clear();
+            next = 0;
+            dropped = 0;
+            working = threadCount;
+            round++;
+            wake.notify_all();
+            idle.wait(lock, [&] { return working == 0; });
+        }
+
+        // Expanded parents only need to remember how they were reached
+        for (size_t i = 0; i < batch.size(); i++) nodes[batch[i]].state.reset();
+        expanded += batch.size();
+        duplicates += dropped;
+
+        for (int t = 0; t < threadCount && found < 0; t++)
+        {
+            for (size_t i = 0; i < children[t].size(); i++)
+            {
+                int index = (int)nodes.size();
+                const Chip8& state = *children[t][i].state;
+
+                if (goal(state)) found = index;
+
+                int score = mode == BEST_FIRST && heuristic ? heuristic(state) : children[t][i].depth;
+                open.push(Entry(score, index));
+                nodes.push_back(std::move(children[t][i]));
+
+                if (found >= 0) break;
+            }
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (int t = 0; t < threadCount; t++) workers[t].join();
+
+    if (found < 0) return false;
+
+    inputs.clear();
+    for (int n = found; nodes[n].parent >= 0; n = nodes[n].parent) inputs.push_back(nodes[n].input);
+    std::reverse(inputs.begin(), inputs.end());
+    return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+#include "Chip8.h"
+
+/*
+ * State-space search over keypad inputs
+ *
+ * Starting from a machine, every frame is expanded once per keypad input (nothing held, or one of
+ * the 16 keys held for the frame). Resulting states are hashed and duplicates dropped, and the
+ * search stops at the first state the goal predicate accepts. Run starts its worker threads once;
+ * each round they expand a batch of open states between them.
+ */
+class StateSearch
+{
+public:
+    enum Mode
+    {
+        BREADTH_FIRST,
+        BEST_FIRST
+    };
+
+    // Inputs per frame: NO_KEY, or the index of the single key held down
+    static const int NO_KEY = -1;
+
+    typedef std::function<bool(const Chip8&)> Goal;
+
+    // Lower scores are expanded first in BEST_FIRST mode
+    typedef std::function<int(const Chip8&)> Heuristic;
+
+    StateSearch(int threadCount);
+
+    // On success fills `inputs` with one entry per frame from `start` to the goal
+    bool Run(const Chip8& start, const Goal& goal, std::vector<int>& inputs);
+
+    Mode mode;
+    Heuristic heuristic;
+    size_t maxStates;
+
+    size_t expanded;
+    size_t duplicates;
+private:
+    struct Node
+    {
+        std::unique_ptr<Chip8> state;
+        int parent;
+        int input;
+        int depth;
+    };
+
+    int threadCount;
+};
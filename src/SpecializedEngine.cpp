@@ -0,0 +1,327 @@
+#include "SpecializedEngine.h"
+
+#include <algorithm>
+#include <vector>
+
+// Instructions::Decode as a C++11 constant expression, so it can pick template arguments
+static constexpr int AluKind(int low)
+{
+    return low == 0x0 ? Instructions::LD_8XY0 : low == 0x1 ? Instructions::OR_8XY1 : low == 0x2 ? Instructions::AND_8XY2
+         : low == 0x3 ? Instructions::XOR_8XY3 : low == 0x4 ? Instructions::ADD_8XY4 : low == 0x5 ? Instructions::SUB_8XY5
+         : low == 0x6 ? Instructions::SHR_8XY6 : low == 0x7 ? Instructions::SUBN_8XY7 : low == 0xE ? Instructions::SHL_8XYE
+         : Instructions::FALLBACK;
+}
+
+static constexpr int MiscKind(int low)
+{
+    return low == 0x07 ? Instructions::LD_FX07 : low == 0x0A ? Instructions::LD_FX0A : low == 0x15 ? Instructions::LD_FX15
+         : low == 0x18 ? Instructions::LD_FX18 : low == 0x1E ? Instructions::ADD_FX1E : low == 0x29 ? Instructions::LD_FX29
+         : low == 0x33 ? Instructions::BCD_FX33 : low == 0x55 ? Instructions::LD_FX55 : low == 0x65 ? Instructions::LD_FX65
+         : Instructions::FALLBACK;
+}
+
+static constexpr int KindOf(int opcode)
+{
+    return (opcode >> 12) == 0x0 ? ((opcode & 0xFF) == 0xE0 ? Instructions::CLS_00E0
+                                    : (opcode & 0xFF) == 0xEE ? Instructions::RET_00EE : Instructions::FALLBACK)
+         : (opcode >> 12) == 0x1 ? Instructions::JP_1NNN
+         : (opcode >> 12) == 0x2 ? Instructions::CALL_2NNN
+         : (opcode >> 12) == 0x3 ? Instructions::SE_3XKK
+         : (opcode >> 12) == 0x4 ? Instructions::SNE_4XKK
+         : (opcode >> 12) == 0x5 ? Instructions::SE_5XY0
+         : (opcode >> 12) == 0x6 ? Instructions::LD_6XKK
+         : (opcode >> 12) == 0x7 ? Instructions::ADD_7XKK
+         : (opcode >> 12) == 0x8 ? AluKind(opcode & 0xF)
+         : (opcode >> 12) == 0x9 ? Instructions::SNE_9XY0
+         : (opcode >> 12) == 0xA ? Instructions::LD_ANNN
+         : (opcode >> 12) == 0xB ? Instructions::JP_BNNN
+         : (opcode >> 12) == 0xC ? Instructions::RND_CXKK
+         : (opcode >> 12) == 0xD ? Instructions::DRW_DXYN
+         : (opcode >> 12) == 0xE ? ((opcode & 0xFF) == 0x9E ? Instructions::SKP_EX9E
+                                    : (opcode & 0xFF) == 0xA1 ? Instructions::SKNP_EXA1 : Instructions::FALLBACK)
+         : MiscKind(opcode & 0xFF);
+}
+
+// Register indices a kind does not read are fixed at 0, so those opcodes share one instance
+static constexpr bool UsesX(int kind)
+{
+    return kind != Instructions::FALLBACK && kind != Instructions::CLS_00E0 && kind != Instructions::RET_00EE
+           && kind != Instructions::JP_1NNN && kind != Instructions::CALL_2NNN && kind != Instructions::LD_ANNN
+           && kind != Instructions::JP_BNNN;
+}
+
+static constexpr bool UsesY(int kind)
+{
+    return kind == Instructions::SE_5XY0 || kind == Instructions::SNE_9XY0 || kind == Instructions::DRW_DXYN
+           || (kind >= Instructions::LD_8XY0 && kind <= Instructions::SUBN_8XY7 && kind != Instructions::SHR_8XY6);
+}
+
+static constexpr int XOf(int opcode) { return UsesX(KindOf(opcode)) ? (opcode >> 8) & 0xF : 0; }
+static constexpr int YOf(int opcode) { return UsesY(KindOf(opcode)) ? (opcode >> 4) & 0xF : 0; }
+
+template <int KIND, int X, int Y>
+static uint16_t Execute(Chip8& chip8, const SpecializedEngine::Op& op, uint16_t pc)
+{
+    uint8_t* V = Instructions::V(chip8);
+
+    switch (KIND)
+    {
+        // Unknown opcodes and opcodes split across pages; Update ticks the timers itself
+        case Instructions::FALLBACK:
+        {
+            Instructions::PC(chip8) = pc;
+            chip8.Update();
+            return Instructions::PC(chip8);
+        }
+
+        case Instructions::CLS_00E0: Instructions::Clear(chip8); pc += 2; break;
+        case Instructions::RET_00EE: Instructions::Return(chip8); pc = Instructions::PC(chip8); break;
+        case Instructions::JP_1NNN: pc = op.nnn; break;
+        case Instructions::CALL_2NNN: Instructions::PC(chip8) = pc; Instructions::Call(chip8, op.nnn); pc = op.nnn; break;
+        case Instructions::SE_3XKK: pc += V[X] == op.kk ? 4 : 2; break;
+        case Instructions::SNE_4XKK: pc += V[X] != op.kk ? 4 : 2; break;
+        case Instructions::SE_5XY0: pc += V[X] == V[Y] ? 4 : 2; break;
+        case Instructions::LD_6XKK: V[X] = op.kk; pc += 2; break;
+        case Instructions::ADD_7XKK: V[X] += op.kk; pc += 2; break;
+        case Instructions::LD_8XY0: V[X] = V[Y]; pc += 2; break;
+        case Instructions::OR_8XY1: V[X] |= V[Y]; pc += 2; break;
+        case Instructions::AND_8XY2: V[X] &= V[Y]; pc += 2; break;
+        case Instructions::XOR_8XY3: V[X] ^= V[Y]; pc += 2; break;
+
+        // VF is written before the result, exactly as Update orders it, so x or y == F behaves the same
+        case Instructions::ADD_8XY4: V[0xF] = (int)V[X] + (int)V[Y] < 256 ? 0 : 1; V[X] += V[Y]; pc += 2; break;
+        case Instructions::SUB_8XY5: V[0xF] = V[X] < V[Y] ? 0 : 1; V[X] -= V[Y]; pc += 2; break;
+        case Instructions::SHR_8XY6: V[0xF] = V[X] & 0x1; V[X] = V[X] >> 1; pc += 2; break;
+        case Instructions::SUBN_8XY7: V[0xF] = V[Y] < V[X] ? 0 : 1; V[X] = V[Y] - V[X]; pc += 2; break;
+        case Instructions::SHL_8XYE: V[0xF] = V[X] >> 7; V[X] = V[X] << 1; pc += 2; break;
+
+        case Instructions::SNE_9XY0: pc += V[X] != V[Y] ? 4 : 2; break;
+        case Instructions::LD_ANNN: Instructions::I(chip8) = op.nnn; pc += 2; break;
+        case Instructions::JP_BNNN: pc = op.nnn + V[0]; break;
+        case Instructions::RND_CXKK: V[X] = Instructions::Random(chip8) & op.kk; pc += 2; break;
+        case Instructions::DRW_DXYN: Instructions::Draw<DefaultQuirks>(chip8, X, Y, op.n); pc += 2; break;
+        case Instructions::SKP_EX9E: pc += Instructions::KeyDown(chip8, X) ? 4 : 2; break;
+        case Instructions::SKNP_EXA1: pc += Instructions::KeyDown(chip8, X) ? 2 : 4; break;
+        case Instructions::LD_FX07: V[X] = Instructions::DelayTimer(chip8); pc += 2; break;
+        case Instructions::LD_FX0A: Instructions::PC(chip8) = pc; Instructions::WaitKey(chip8, X); pc = Instructions::PC(chip8); break;
+        case Instructions::LD_FX15: Instructions::DelayTimer(chip8) = V[X]; pc += 2; break;
+        case Instructions::LD_FX18: Instructions::SoundTimer(chip8) = V[X]; pc += 2; break;
+        case Instructions::ADD_FX1E: Instructions::I(chip8) += V[X]; pc += 2; break;
+        case Instructions::LD_FX29: Instructions::I(chip8) = 5 * V[X]; pc += 2; break;
+        case Instructions::BCD_FX33: Instructions::Bcd(chip8, X); pc += 2; break;
+        case Instructions::LD_FX55: Instructions::Store<DefaultQuirks>(chip8, X); pc += 2; break;
+        case Instructions::LD_FX65: Instructions::Load<DefaultQuirks>(chip8, X); pc += 2; break;
+    }
+
+    Instructions::Tick(chip8);
+    return pc;
+}
+
+// C++11 has no std::integer_sequence; this builds 0..N-1 by halves so the nesting depth stays at log2(N)
+template <int... I>
+struct Sequence
+{
+};
+
+template <class A, class B>
+struct Concat;
+
+template <int... A, int... B>
+struct Concat<Sequence<A...>, Sequence<B...>>
+{
+    typedef Sequence<A..., (int)sizeof...(A) + B...> Type;
+};
+
+template <int N>
+struct MakeSequence
+{
+    typedef typename Concat<typename MakeSequence<N / 2>::Type, typename MakeSequence<N - N / 2>::Type>::Type Type;
+};
+
+template <>
+struct MakeSequence<1>
+{
+    typedef Sequence<0> Type;
+};
+
+template <class S>
+struct HandlerTable;
+
+template <int... OPCODE>
+struct HandlerTable<Sequence<OPCODE...>>
+{
+    static constexpr SpecializedEngine::Handler entries[sizeof...(OPCODE)] = {&Execute<KindOf(OPCODE), XOf(OPCODE), YOf(OPCODE)>...};
+};
+
+template <int... OPCODE>
+constexpr SpecializedEngine::Handler HandlerTable<Sequence<OPCODE...>>::entries[sizeof...(OPCODE)];
+
+typedef HandlerTable<MakeSequence<65536>::Type> OpcodeHandlers;
+
+SpecializedEngine::Handler SpecializedEngine::HandlerFor(uint16_t opcode)
+{
+    return OpcodeHandlers::entries[opcode];
+}
+
+int SpecializedEngine::HandlerCount()
+{
+    std::vector<Handler> handlers(OpcodeHandlers::entries, OpcodeHandlers::entries + 65536);
+    std::sort(handlers.begin(), handlers.end());
+    return (int)(std::unique(handlers.begin(), handlers.end()) - handlers.begin());
+}
+
+SpecializedEngine::SpecializedEngine()
+{
+    decodes = 0;
+    executed = 0;
+    machine = nullptr;
+    decodedQuirks = QUIRKS_DEFAULT;
+}
+
+// Kinds whose behaviour depends on the quirk profile
+static bool QuirkDependent(int kind)
+{
+    switch (kind)
+    {
+        case Instructions::OR_8XY1:
+        case Instructions::AND_8XY2:
+        case Instructions::XOR_8XY3:
+        case Instructions::SHR_8XY6:
+        case Instructions::SHL_8XYE:
+        case Instructions::JP_BNNN:
+        case Instructions::DRW_DXYN:
+        case Instructions::LD_FX55:
+        case Instructions::LD_FX65:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void SpecializedEngine::Reset()
+{
+    machine = nullptr;
+}
+
+void SpecializedEngine::Flush(const Chip8& chip8)
+{
+    for (int i = 0; i < 4096; i++) code[i].handler = nullptr;
+    for (int page = 0; page < Chip8::PAGE_COUNT; page++) decodedVersions[page] = chip8.PageVersion(page);
+    decodedMemoryVersion = chip8.MemoryVersion();
+}
+
+void SpecializedEngine::Sync(const Chip8& chip8)
+{
+    if (decodedMemoryVersion == chip8.MemoryVersion()) return;
+    decodedMemoryVersion = chip8.MemoryVersion();
+
+    for (int page = 0; page < Chip8::PAGE_COUNT; page++)
+    {
+        if (decodedVersions[page] == chip8.PageVersion(page)) continue;
+
+        for (int i = 0; i < Chip8::PAGE_SIZE; i++) code[(page << 8) | i].handler = nullptr;
+        decodedVersions[page] = chip8.PageVersion(page);
+    }
+}
+
+void SpecializedEngine::Invalidate(const Chip8& chip8, uint16_t address, int count)
+{
+    // A record reads two bytes, so the one starting just before the first written byte is stale too
+    for (int i = -1; i < count; i++) code[(address + i) & 0xFFF].handler = nullptr;
+    for (int page = 0; page < Chip8::PAGE_COUNT; page++) decodedVersions[page] = chip8.PageVersion(page);
+    decodedMemoryVersion = chip8.MemoryVersion();
+}
+
+void SpecializedEngine::Decode(const Chip8& chip8, uint16_t address)
+{
+    Op& op = code[address];
+    uint16_t opcode = Instructions::Fetch(chip8, address);
+
+    op.handler = HandlerFor(opcode);
+    op.nnn = opcode & 0xFFF;
+    op.kk = opcode & 0xFF;
+    op.n = opcode & 0xF;
+
+    Instructions::Kind kind = Instructions::Decode(opcode);
+    switch (kind)
+    {
+        case Instructions::BCD_FX33: op.stores = 3; break;
+        case Instructions::LD_FX55: op.stores = ((opcode >> 8) & 0xF) + 1; break;
+        case Instructions::FALLBACK: op.stores = STORES_ANYWHERE; break;
+        default: op.stores = 0; break;
+    }
+
+    // An opcode split across two pages would go stale with either of them; leave it to Update. So
+    // do the instructions another profile changes: the table is built for the default profile only,
+    // since one per profile would multiply the compile time
+    if ((address & 0xFF) == 0xFF || (decodedQuirks != QUIRKS_DEFAULT && QuirkDependent(kind)))
+    {
+        op.handler = HandlerFor(0x0000);
+        op.stores = STORES_ANYWHERE;
+    }
+    decodes++;
+}
+
+void SpecializedEngine::Run(Chip8& chip8, long count)
+{
+    // Records decoded under one profile may point at default-profile handlers another one must not use
+    if (&chip8 != machine || chip8.Quirks() != decodedQuirks)
+    {
+        Flush(chip8);
+        machine = &chip8;
+        decodedQuirks = chip8.Quirks();
+    }
+
+    // Memory may have been written from outside since the last call
+    Sync(chip8);
+
+    executed += count;
+    if (chip8.Bounds() == BOUNDS_FAULT) Execute<true>(chip8, count);
+    else Execute<false>(chip8, count);
+}
+
+template <bool CHECKED>
+void SpecializedEngine::Execute(Chip8& chip8, long count)
+{
+    uint16_t pc = Instructions::PC(chip8);
+
+    while (count > 0)
+    {
+        // Update halts the machine on a fault
+        if (CHECKED && chip8.Check(pc) != Chip8::FAULT_NONE)
+        {
+            Instructions::PC(chip8) = pc;
+            chip8.Update();
+            pc = Instructions::PC(chip8);
+            count--;
+            continue;
+        }
+
+        const Op& op = code[pc & 0xFFF];
+        if (op.handler == nullptr)
+        {
+            Decode(chip8, pc & 0xFFF);
+            continue;
+        }
+
+        if (op.stores == 0) pc = op.handler(chip8, op, pc);
+        else
+        {
+            uint16_t address = Instructions::I(chip8);
+            uint8_t stores = op.stores;
+            pc = op.handler(chip8, op, pc);
+
+            if (stores == STORES_ANYWHERE) Sync(chip8);
+            else Invalidate(chip8, address, stores);
+        }
+        count--;
+    }
+
+    Instructions::PC(chip8) = pc;
+}
+
+void SpecializedEngine::WriteReport(std::ostream& out) const
+{
+    out << "  " << HandlerCount() << " specialized handlers, " << decodes << " decodes for " << executed
+        << " instructions\n";
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <ostream>
+#include <stdint.h>
+
+#include "Engine.h"
+#include "Instructions.h"
+
+/*
+ * Interpreter with compile-time specialized handlers
+ *
+ * Each handler is a template instance for one instruction kind and one pair of register indices,
+ * so V[x] and V[y] are fixed offsets instead of fields pulled out of the opcode. A table built at
+ * compile time maps all 65536 opcodes to their handler. Immediates (kk, n, nnn) stay in the
+ * decoded record: specializing on them too would mean one instance per opcode.
+ *
+ * Every address is decoded once into a record of handler and immediates; records are dropped when
+ * the bytes they came from change, as in PredecodeEngine. Handlers tick the timers themselves and
+ * return the next pc.
+ *
+ * The handlers implement the default quirk profile. Under any other profile the instructions it
+ * changes are decoded to the Update fallback instead, which follows the machine's profile.
+ *
+ * Only built with CHIP8_SPECIALIZED_ENGINE, which is off by default: it is a measurement build
+ * for comparing dispatch strategies and costs more compile time than the rest of the core.
+ */
+class SpecializedEngine : public Engine
+{
+public:
+    struct Op;
+    typedef uint16_t (*Handler)(Chip8& chip8, const Op& op, uint16_t pc);
+
+    struct Op
+    {
+        Handler handler;
+        uint16_t nnn;
+        uint8_t kk;
+        uint8_t n;
+
+        // Bytes the instruction stores at I, or STORES_ANYWHERE for opcodes left to Update
+        uint8_t stores;
+    };
+
+    static const uint8_t STORES_ANYWHERE = 0xFF;
+
+    SpecializedEngine(void);
+
+    void Run(Chip8& chip8, long count);
+    void Reset(void);
+    void WriteReport(std::ostream& out) const;
+
+    // The handler for any opcode, from the compile-time table
+    static Handler HandlerFor(uint16_t opcode);
+
+    // Number of distinct handlers the table refers to
+    static int HandlerCount(void);
+
+    uint64_t decodes;
+    uint64_t executed;
+private:
+    // The run loop, checking each instruction for faults when CHECKED (see BoundsMode in Quirks.h)
+    template <bool CHECKED>
+    void Execute(Chip8& chip8, long count);
+
+    void Flush(const Chip8& chip8);
+    void Sync(const Chip8& chip8);
+    void Invalidate(const Chip8& chip8, uint16_t address, int count);
+    void Decode(const Chip8& chip8, uint16_t address);
+
+    Op code[4096];
+    uint32_t decodedVersions[Chip8::PAGE_COUNT];
+    uint32_t decodedMemoryVersion;
+    const Chip8* machine;
+
+    // Profile the records were decoded under
+    QuirkProfile decodedQuirks;
+};
@@ -0,0 +1,346 @@
+#include "ThreadedEngine.h"
+
+#include <iomanip>
+#include <string.h>
+
+ThreadedEngine::ThreadedEngine()
+{
+    decodes = 0;
+    executed = 0;
+    machine = nullptr;
+    decodedQuirks = QUIRKS_DEFAULT;
+    decodedBounds = BOUNDS_WRAP;
+#ifdef CHIP8_COMPUTED_GOTO
+    undecodedHandler = nullptr;
+#endif
+}
+
+bool ThreadedEngine::Threaded()
+{
+#ifdef CHIP8_COMPUTED_GOTO
+    return true;
+#else
+    return false;
+#endif
+}
+
+void ThreadedEngine::Reset()
+{
+    machine = nullptr;
+}
+
+void ThreadedEngine::Drop(uint16_t address)
+{
+    code[address].kind = UNDECODED;
+#ifdef CHIP8_COMPUTED_GOTO
+    code[address].handler = undecodedHandler;
+#endif
+}
+
+void ThreadedEngine::Flush(const Chip8& chip8)
+{
+    for (int i = 0; i < 4096; i++) Drop(i);
+    for (int page = 0; page < Chip8::PAGE_COUNT; page++) decodedVersions[page] = chip8.PageVersion(page);
+    decodedMemoryVersion = chip8.MemoryVersion();
+}
+
+void ThreadedEngine::Sync(const Chip8& chip8)
+{
+    if (decodedMemoryVersion == chip8.MemoryVersion()) return;
+    decodedMemoryVersion = chip8.MemoryVersion();
+
+    for (int page = 0; page < Chip8::PAGE_COUNT; page++)
+    {
+        if (decodedVersions[page] == chip8.PageVersion(page)) continue;
+
+        for (int i = 0; i < Chip8::PAGE_SIZE; i++) Drop((page << 8) | i);
+        decodedVersions[page] = chip8.PageVersion(page);
+    }
+}
+
+void ThreadedEngine::Invalidate(const Chip8& chip8, uint16_t address, int count)
+{
+    // A record reads two bytes, so the one starting just before the first written byte is stale too
+    for (int i = -1; i < count; i++) Drop((address + i) & 0xFFF);
+    for (int page = 0; page < Chip8::PAGE_COUNT; page++) decodedVersions[page] = chip8.PageVersion(page);
+    decodedMemoryVersion = chip8.MemoryVersion();
+}
+
+void ThreadedEngine::Decode(const Chip8& chip8, uint16_t address)
+{
+    Decoded& decoded = code[address];
+    uint16_t opcode = Instructions::Fetch(chip8, address);
+
+    decoded.kind = Instructions::Decode(opcode);
+    decoded.x = (opcode >> 8) & 0xF;
+    decoded.y = (opcode >> 4) & 0xF;
+    decoded.n = opcode & 0xF;
+    decoded.kk = opcode & 0xFF;
+    decoded.nnn = opcode & 0xFFF;
+
+    // An opcode split across two pages would go stale with either of them; leave it to Update
+    if ((address & 0xFF) == 0xFF) decoded.kind = Instructions::FALLBACK;
+
+    // Lazy VF would be wrong for an op that reads VF or whose result lands in it
+    decoded.touchesFlag = decoded.x == 0xF || decoded.y == 0xF;
+    if (decoded.touchesFlag && decoded.kind >= Instructions::ADD_8XY4 && decoded.kind <= Instructions::SHL_8XYE)
+    {
+        decoded.kind = ADD_8XY4_EAGER + (decoded.kind - Instructions::ADD_8XY4);
+    }
+    decodes++;
+}
+
+/*
+ * Handlers are written once and expanded two ways. With computed goto, TARGET names a label and
+ * DISPATCH jumps through the next record's handler address; otherwise TARGET is a case of the
+ * switch at `dispatch` and DISPATCH goes back to it. NEXT ends an instruction the way Update does,
+ * by ticking the timers, then stops if the budget is spent. In BOUNDS_FAULT instances CHECK sends
+ * an instruction that faults to Update, which halts the machine.
+ *
+ * V, I, pc and the timers live in locals for the whole call. Nothing outside the loop can reach
+ * them, so the compiler keeps them apart from the display and memory stores instead of reloading
+ * them after each one. SPILL writes them back to the machine before anything that reads its
+ * registers, and FILL reloads them after anything that may have changed them.
+ *
+ * flag holds the unreduced result of the last flag-setting op, or -1 once VF is up to date; SETTLE
+ * reduces it into VF. Every SPILL settles first, so the machine never sees a pending flag.
+ */
+#define SETTLE()                                    \
+    do                                              \
+    {                                               \
+        if (flag >= 0)                              \
+        {                                           \
+            V[0xF] = (flag >> 8) & 1;               \
+            flag = -1;                              \
+        }                                           \
+    } while (0)
+
+#define SPILL()                                     \
+    do                                              \
+    {                                               \
+        SETTLE();                                   \
+        memcpy(Instructions::V(chip8), V, 16);      \
+        Instructions::I(chip8) = I;                 \
+        Instructions::PC(chip8) = pc;               \
+        Instructions::DelayTimer(chip8) = delay;    \
+        Instructions::SoundTimer(chip8) = sound;    \
+    } while (0)
+
+#define FILL()                                      \
+    do                                              \
+    {                                               \
+        memcpy(V, Instructions::V(chip8), 16);      \
+        I = Instructions::I(chip8);                 \
+        pc = Instructions::PC(chip8);               \
+        delay = Instructions::DelayTimer(chip8);    \
+        sound = Instructions::SoundTimer(chip8);    \
+    } while (0)
+
+#define CHECK()                                     \
+    do                                              \
+    {                                               \
+        if (Q::BOUNDS == BOUNDS_FAULT)              \
+        {                                           \
+            SPILL();                                \
+            if (chip8.Check(pc) != Chip8::FAULT_NONE) goto fallback; \
+        }                                           \
+    } while (0)
+
+#ifdef CHIP8_COMPUTED_GOTO
+#define TARGET(kind) op_##kind
+#define FLAG_TARGET(kind) op_##kind
+#define DISPATCH()                                  \
+    do                                              \
+    {                                               \
+        CHECK();                                    \
+        decoded = &code[pc & 0xFFF];                \
+        goto *decoded->handler;                     \
+    } while (0)
+#else
+#define FLAG_TARGET(kind) case kind
+#define TARGET(kind) case Instructions::kind
+#define DISPATCH() goto dispatch
+#endif
+
+#define NEXT()                                      \
+    do                                              \
+    {                                               \
+        if (delay > 0) delay--;                     \
+        if (sound > 0) sound--;                     \
+        if (--count == 0) goto done;                \
+        DISPATCH();                                 \
+    } while (0)
+
+// Runs Execute with the machine's quirk profile and bounds mode as its template argument
+struct ThreadedEngine::Runner
+{
+    ThreadedEngine* engine;
+    Chip8* chip8;
+    long count;
+
+    template <class Q>
+    void Run(void) { engine->Execute<Q>(*chip8, count); }
+};
+
+void ThreadedEngine::Run(Chip8& chip8, long count)
+{
+    if (count <= 0) return;
+
+    Runner runner = {this, &chip8, count};
+    VisitQuirks(chip8.Quirks(), chip8.Bounds(), runner);
+}
+
+template <class Q>
+void ThreadedEngine::Execute(Chip8& chip8, long count)
+{
+#ifdef CHIP8_COMPUTED_GOTO
+    // In Instructions::Kind order
+    static const void* const handlers[HANDLER_COUNT] = {
+        &&op_FALLBACK, &&op_CLS_00E0, &&op_RET_00EE, &&op_JP_1NNN, &&op_CALL_2NNN, &&op_SE_3XKK,
+        &&op_SNE_4XKK, &&op_SE_5XY0, &&op_LD_6XKK, &&op_ADD_7XKK, &&op_LD_8XY0, &&op_OR_8XY1,
+        &&op_AND_8XY2, &&op_XOR_8XY3, &&op_ADD_8XY4, &&op_SUB_8XY5, &&op_SHR_8XY6, &&op_SUBN_8XY7,
+        &&op_SHL_8XYE, &&op_SNE_9XY0, &&op_LD_ANNN, &&op_JP_BNNN, &&op_RND_CXKK, &&op_DRW_DXYN,
+        &&op_SKP_EX9E, &&op_SKNP_EXA1, &&op_LD_FX07, &&op_LD_FX0A, &&op_LD_FX15, &&op_LD_FX18,
+        &&op_ADD_FX1E, &&op_LD_FX29, &&op_BCD_FX33, &&op_LD_FX55, &&op_LD_FX65, &&op_ADD_8XY4_EAGER,
+        &&op_SUB_8XY5_EAGER, &&op_SHR_8XY6_EAGER, &&op_SUBN_8XY7_EAGER, &&op_SHL_8XYE_EAGER};
+    undecodedHandler = &&op_UNDECODED;
+#endif
+
+    // Each quirk profile and bounds mode has its own copy of the handlers, so records pointing into
+    // another one are flushed
+    if (&chip8 != machine || chip8.Quirks() != decodedQuirks || chip8.Bounds() != decodedBounds)
+    {
+        Flush(chip8);
+        machine = &chip8;
+        decodedQuirks = chip8.Quirks();
+        decodedBounds = chip8.Bounds();
+    }
+
+    // Memory may have been written from outside since the last call
+    Sync(chip8);
+
+    uint8_t V[16];
+    uint16_t I;
+    uint16_t pc;
+    uint8_t delay;
+    uint8_t sound;
+    int flag = -1;
+    FILL();
+
+    const long budget = count;
+    const Decoded* decoded;
+
+    DISPATCH();
+
+#ifndef CHIP8_COMPUTED_GOTO
+dispatch:
+    CHECK();
+    decoded = &code[pc & 0xFFF];
+    if (decoded->kind != UNDECODED && decoded->touchesFlag) SETTLE();
+    switch (decoded->kind)
+#endif
+    {
+        TARGET(CLS_00E0): Instructions::Clear(chip8); pc += 2; NEXT();
+        TARGET(RET_00EE): Instructions::Return(chip8); pc = Instructions::PC(chip8); NEXT();
+        TARGET(JP_1NNN): pc = decoded->nnn; NEXT();
+        TARGET(CALL_2NNN): Instructions::PC(chip8) = pc; Instructions::Call(chip8, decoded->nnn); pc = decoded->nnn; NEXT();
+        TARGET(SE_3XKK): pc += V[decoded->x] == decoded->kk ? 4 : 2; NEXT();
+        TARGET(SNE_4XKK): pc += V[decoded->x] != decoded->kk ? 4 : 2; NEXT();
+        TARGET(SE_5XY0): pc += V[decoded->x] == V[decoded->y] ? 4 : 2; NEXT();
+        TARGET(LD_6XKK): V[decoded->x] = decoded->kk; pc += 2; NEXT();
+        TARGET(ADD_7XKK): V[decoded->x] += decoded->kk; pc += 2; NEXT();
+        TARGET(LD_8XY0): V[decoded->x] = V[decoded->y]; pc += 2; NEXT();
+        TARGET(OR_8XY1): V[decoded->x] |= V[decoded->y]; if (Q::LOGIC_RESETS_VF) { V[0xF] = 0; flag = -1; } pc += 2; NEXT();
+        TARGET(AND_8XY2): V[decoded->x] &= V[decoded->y]; if (Q::LOGIC_RESETS_VF) { V[0xF] = 0; flag = -1; } pc += 2; NEXT();
+        TARGET(XOR_8XY3): V[decoded->x] ^= V[decoded->y]; if (Q::LOGIC_RESETS_VF) { V[0xF] = 0; flag = -1; } pc += 2; NEXT();
+
+        // Neither x nor y is F here; bit 8 of flag is the carry, the absence of a borrow or the bit shifted out
+        TARGET(ADD_8XY4): flag = V[decoded->x] + V[decoded->y]; V[decoded->x] = flag; pc += 2; NEXT();
+        TARGET(SUB_8XY5): flag = 256 + V[decoded->x] - V[decoded->y]; V[decoded->x] = flag; pc += 2; NEXT();
+        TARGET(SHR_8XY6): flag = V[Q::SHIFT_READS_VY ? decoded->y : decoded->x] << 8; V[decoded->x] = flag >> 9; pc += 2; NEXT();
+        TARGET(SUBN_8XY7): flag = 256 + V[decoded->y] - V[decoded->x]; V[decoded->x] = flag; pc += 2; NEXT();
+        TARGET(SHL_8XYE): flag = V[Q::SHIFT_READS_VY ? decoded->y : decoded->x] << 1; V[decoded->x] = flag; pc += 2; NEXT();
+
+        // VF is written before the result, exactly as Update orders it, so x or y == F behaves the same
+        FLAG_TARGET(ADD_8XY4_EAGER): V[0xF] = (int)V[decoded->x] + (int)V[decoded->y] < 256 ? 0 : 1; V[decoded->x] += V[decoded->y]; pc += 2; NEXT();
+        FLAG_TARGET(SUB_8XY5_EAGER): V[0xF] = V[decoded->x] < V[decoded->y] ? 0 : 1; V[decoded->x] -= V[decoded->y]; pc += 2; NEXT();
+        FLAG_TARGET(SHR_8XY6_EAGER): V[0xF] = V[Q::SHIFT_READS_VY ? decoded->y : decoded->x] & 0x1; V[decoded->x] = V[Q::SHIFT_READS_VY ? decoded->y : decoded->x] >> 1; pc += 2; NEXT();
+        FLAG_TARGET(SUBN_8XY7_EAGER): V[0xF] = V[decoded->y] < V[decoded->x] ? 0 : 1; V[decoded->x] = V[decoded->y] - V[decoded->x]; pc += 2; NEXT();
+        FLAG_TARGET(SHL_8XYE_EAGER): V[0xF] = V[Q::SHIFT_READS_VY ? decoded->y : decoded->x] >> 7; V[decoded->x] = V[Q::SHIFT_READS_VY ? decoded->y : decoded->x] << 1; pc += 2; NEXT();
+
+        TARGET(SNE_9XY0): pc += V[decoded->x] != V[decoded->y] ? 4 : 2; NEXT();
+        TARGET(LD_ANNN): I = decoded->nnn; pc += 2; NEXT();
+        TARGET(JP_BNNN): pc = decoded->nnn + V[Q::JUMP_USES_VX ? decoded->x : 0]; NEXT();
+        TARGET(RND_CXKK): V[decoded->x] = Instructions::Random(chip8) & decoded->kk; pc += 2; NEXT();
+        TARGET(DRW_DXYN): V[0xF] = Instructions::Draw<Q>(chip8, V[decoded->x], V[decoded->y], I, decoded->n); flag = -1; pc += 2; NEXT();
+        TARGET(SKP_EX9E): pc += Instructions::KeyPressed(chip8, V[decoded->x]) ? 4 : 2; NEXT();
+        TARGET(SKNP_EXA1): pc += Instructions::KeyPressed(chip8, V[decoded->x]) ? 2 : 4; NEXT();
+        TARGET(LD_FX07): V[decoded->x] = delay; pc += 2; NEXT();
+        TARGET(LD_FX0A): pc = Instructions::WaitKey(chip8, V[decoded->x], pc); NEXT();
+        TARGET(LD_FX15): delay = V[decoded->x]; pc += 2; NEXT();
+        TARGET(LD_FX18): sound = V[decoded->x]; pc += 2; NEXT();
+        TARGET(ADD_FX1E): I += V[decoded->x]; pc += 2; NEXT();
+        TARGET(LD_FX29): I = 5 * V[decoded->x]; pc += 2; NEXT();
+        TARGET(BCD_FX33): Instructions::Bcd(chip8, I, V[decoded->x]); Invalidate(chip8, I, 3); pc += 2; NEXT();
+        TARGET(LD_FX55):
+        {
+            uint16_t at = I;
+            Instructions::Store<Q>(chip8, V, I, decoded->x);
+            Invalidate(chip8, at, decoded->x + 1);
+            pc += 2;
+            NEXT();
+        }
+        TARGET(LD_FX65): Instructions::Load<Q>(chip8, V, I, decoded->x); pc += 2; NEXT();
+
+        // Unknown opcodes and opcodes split across pages; Update ticks the timers itself and may write anywhere
+        TARGET(FALLBACK):
+        fallback:
+        {
+            SPILL();
+            chip8.Update();
+            FILL();
+            Sync(chip8);
+            if (--count == 0) goto done;
+            DISPATCH();
+        }
+
+#ifdef CHIP8_COMPUTED_GOTO
+        // Records that name VF settle it before running their handler
+    op_SETTLE:
+        {
+            SETTLE();
+            goto *handlers[decoded->kind];
+        }
+
+    op_UNDECODED:
+#else
+        default:
+#endif
+        {
+            Decode(chip8, pc & 0xFFF);
+#ifdef CHIP8_COMPUTED_GOTO
+            code[pc & 0xFFF].handler = code[pc & 0xFFF].touchesFlag ? &&op_SETTLE : handlers[code[pc & 0xFFF].kind];
+#endif
+            DISPATCH();
+        }
+    }
+
+done:
+    SPILL();
+    executed += budget;
+}
+
+#undef SETTLE
+#undef SPILL
+#undef FILL
+#undef CHECK
+#undef TARGET
+#undef FLAG_TARGET
+#undef DISPATCH
+#undef NEXT
+
+void ThreadedEngine::WriteReport(std::ostream& out) const
+{
+    out << "  " << (Threaded() ? "computed goto" : "switch") << " dispatch, " << decodes << " decodes for "
+        << executed << " instructions\n";
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <ostream>
+#include <stdint.h>
+
+#include "Engine.h"
+#include "Instructions.h"
+
+// GCC and Clang support labels as values; CHIP8_NO_COMPUTED_GOTO forces the portable loop anyway
+#if defined(__GNUC__) && !defined(CHIP8_NO_COMPUTED_GOTO)
+#define CHIP8_COMPUTED_GOTO
+#endif
+
+/*
+ * Direct-threaded interpreter
+ *
+ * Every address is decoded once into a record holding the address of its handler, and every
+ * handler ends by jumping straight to the handler of the next record. With one indirect jump per
+ * handler instead of the single one a switch shares, the branch predictor learns which handler
+ * tends to follow which, which is most of what makes this faster than Chip8::Update.
+ *
+ * Without computed goto (see CHIP8_COMPUTED_GOTO above) the same handlers run from a switch, so
+ * results are identical either way; only the dispatch differs. Records are dropped when the bytes
+ * they were decoded from change, exactly as in PredecodeEngine.
+ *
+ * Registers, I, pc and the timers are copied into locals for the length of a Run call and written
+ * back to the machine when it returns or hands an instruction to Update, so a Chip8 looks the same
+ * from outside as it would after the reference engine.
+ *
+ * VF from 8xy4, 8xy5, 8xy6, 8xy7 and 8xyE is evaluated lazily: the handler keeps the unreduced
+ * result, whose bit 8 is the flag, and VF is only computed from it when something can see it.
+ * Records whose x or y is F go through a stub that settles VF first, and take the eager form of
+ * those ops; Dxyn and the logic ops under LOGIC_RESETS_VF drop a pending flag they overwrite.
+ */
+class ThreadedEngine : public Engine
+{
+public:
+    ThreadedEngine(void);
+
+    void Run(Chip8& chip8, long count);
+    void Reset(void);
+    void WriteReport(std::ostream& out) const;
+
+    // Whether this build dispatches with computed goto or with the portable switch
+    static bool Threaded(void);
+
+    uint64_t decodes;
+    uint64_t executed;
+private:
+    struct Decoded
+    {
+#ifdef CHIP8_COMPUTED_GOTO
+        const void* handler;
+#endif
+        uint8_t kind;
+
+        // Whether x or y is F, so VF has to be settled before the record runs
+        bool touchesFlag;
+        uint8_t x;
+        uint8_t y;
+        uint8_t n;
+        uint8_t kk;
+        uint16_t nnn;
+    };
+
+    static const int UNDECODED = 0xFF;
+
+    // The flag-setting ALU ops with VF computed on the spot, for records that name VF, numbered
+    // after Instructions::Kind
+    enum EagerFlagKind
+    {
+        ADD_8XY4_EAGER = Instructions::KIND_COUNT,
+        SUB_8XY5_EAGER,
+        SHR_8XY6_EAGER,
+        SUBN_8XY7_EAGER,
+        SHL_8XYE_EAGER,
+        HANDLER_COUNT
+    };
+
+    struct Runner;
+
+    // The run loop for one quirk profile and bounds mode
+    template <class Q>
+    void Execute(Chip8& chip8, long count);
+
+    void Flush(const Chip8& chip8);
+    void Sync(const Chip8& chip8);
+    void Invalidate(const Chip8& chip8, uint16_t address, int count);
+    void Drop(uint16_t address);
+    void Decode(const Chip8& chip8, uint16_t address);
+
+    Decoded code[4096];
+    uint32_t decodedVersions[Chip8::PAGE_COUNT];
+    uint32_t decodedMemoryVersion;
+    const Chip8* machine;
+
+    // Quirk profile and bounds mode whose handlers the records point at
+    QuirkProfile decodedQuirks;
+    BoundsMode decodedBounds;
+
+#ifdef CHIP8_COMPUTED_GOTO
+    // The decode handler, which records point at until they are decoded; set by the first Run
+    const void* undecodedHandler;
+#endif
+};
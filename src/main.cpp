@@ -1,9 +1,16 @@
 #include <iostream>
 #include <stdint.h>
 #include <SDL.h>
+#include <fstream>
+#include <string.h>
 #include <thread>
 
 #include "Chip8.h"
+#include "Hud.h"
+#include "Metrics.h"
+#include "Netplay.h"
+#include "Probes.h"
+#include "RunAhead.h"
 
 const int SCREEN_WIDTH = 1024;
 const int SCREEN_HEIGHT = 512;
@@ -31,9 +38,122 @@ uint8_t keymap[16] = {
 };
 
 
+// Charges the time since `start` to a metrics stage and returns the end of the stage
+static std::chrono::steady_clock::time_point StageDone(Metrics& metrics, Metrics::Stage stage, std::chrono::steady_clock::time_point start)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    metrics.AddStageTime(stage, std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count());
+    return now;
+}
 
 int main(int argc, char* args[]) 
 {
+    const char* romPath = "../roms/PONG";
+    bool runAhead = false;
+
+    // Netplay: --netplay <player> <players> <port> --peer <host:port> [--delay <frames>] [--latency <ms> <jitter ms>]
+    NetplayTransport transport;
+    bool netplay = false;
+    int netPlayer = -1;
+    int netPlayers = 0;
+    int inputDelay = 2;
+
+    // Profiling (CHIP8_PROFILE builds): --profile <prefix> writes <prefix>.txt and <prefix>.folded on exit
+    std::string profilePrefix;
+
+    // Memory tracking (CHIP8_TRACK_MEMORY builds): --memory-map <prefix> writes <prefix>.csv and <prefix>.ppm on exit
+    std::string memoryMapPrefix;
+
+    // Runtime metrics: --metrics <file|unix:socket path> [--metrics-interval <ms>] streams one JSON line per interval
+    std::string metricsTarget;
+    int metricsInterval = 1000;
+
+    // Quirk profile: --quirks <default|vip|chip48|schip|xochip>
+    QuirkProfile quirks = QUIRKS_DEFAULT;
+
+    // Out-of-range accesses: --bounds <wrap|fault>
+    BoundsMode bounds = BOUNDS_WRAP;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(args[i], "--runahead") == 0) runAhead = true;
+        else if (strcmp(args[i], "--netplay") == 0 && i + 3 < argc)
+        {
+            netplay = true;
+            netPlayer = atoi(args[++i]);
+            netPlayers = atoi(args[++i]);
+            if (!transport.Open((uint16_t)atoi(args[++i]))) exit(3);
+        }
+        else if (strcmp(args[i], "--peer") == 0 && i + 1 < argc)
+        {
+            std::string peer = args[++i];
+            size_t colon = peer.rfind(':');
+            if (colon == std::string::npos || !transport.AddPeer(peer.substr(0, colon).c_str(), (uint16_t)atoi(peer.c_str() + colon + 1))) exit(3);
+        }
+        else if (strcmp(args[i], "--delay") == 0 && i + 1 < argc) inputDelay = atoi(args[++i]);
+        else if (strcmp(args[i], "--profile") == 0 && i + 1 < argc) profilePrefix = args[++i];
+        else if (strcmp(args[i], "--memory-map") == 0 && i + 1 < argc) memoryMapPrefix = args[++i];
+        else if (strcmp(args[i], "--metrics") == 0 && i + 1 < argc) metricsTarget = args[++i];
+        else if (strcmp(args[i], "--metrics-interval") == 0 && i + 1 < argc) metricsInterval = atoi(args[++i]);
+        else if (strcmp(args[i], "--quirks") == 0 && i + 1 < argc)
+        {
+            if (!ParseQuirkProfile(args[++i], quirks))
+            {
+                std::cerr << "Unknown quirk profile " << args[i] << std::endl;
+                exit(3);
+            }
+        }
+        else if (strcmp(args[i], "--bounds") == 0 && i + 1 < argc)
+        {
+            if (!ParseBoundsMode(args[++i], bounds))
+            {
+                std::cerr << "Unknown bounds mode " << args[i] << std::endl;
+                exit(3);
+            }
+        }
+        else if (strcmp(args[i], "--latency") == 0 && i + 2 < argc)
+        {
+            int latency = atoi(args[++i]);
+            transport.SetSimulatedLatency(latency, atoi(args[++i]));
+        }
+        else romPath = args[i];
+    }
+
+    if (netplay && (netPlayers < 1 || netPlayers > RollbackSession::MAX_PLAYERS || netPlayer < 0 || netPlayer >= netPlayers))
+    {
+        std::cerr << "Usage: --netplay <player> <players> <port>, with 1 <= players <= " << RollbackSession::MAX_PLAYERS
+                  << " and 0 <= player < players" << std::endl;
+        exit(3);
+    }
+    if (inputDelay < 0)
+    {
+        std::cerr << "Usage: --delay <frames>, with frames >= 0" << std::endl;
+        exit(3);
+    }
+
+#ifndef CHIP8_PROFILE
+    if (!profilePrefix.empty())
+    {
+        std::cerr << "--profile needs a build with CHIP8_PROFILE=ON" << std::endl;
+        exit(3);
+    }
+#endif
+
+#ifndef CHIP8_TRACK_MEMORY
+    if (!memoryMapPrefix.empty())
+    {
+        std::cerr << "--memory-map needs a build with CHIP8_TRACK_MEMORY=ON" << std::endl;
+        exit(3);
+    }
+#endif
+
+    // Frames adopted from the run-ahead workers never run on the profiled or tracked machine
+    if ((!profilePrefix.empty() || !memoryMapPrefix.empty()) && runAhead)
+    {
+        std::cerr << "--profile and --memory-map cannot be combined with --runahead" << std::endl;
+        exit(3);
+    }
+
     SDL_Window *window = nullptr;
 
     if (SDL_Init(SDL_INIT_EVERYTHING) < 0)
@@ -54,14 +174,51 @@ int main(int argc, char* args[])
 
     SDL_Texture *sdlTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, 64, 32);
 
+    // Performance overlay, toggled with F1 and drawn at 2x over the top-left corner
+    Hud hud;
+    uint32_t hudPixels[Hud::WIDTH * Hud::HEIGHT];
+    SDL_Rect hudRect = {0, 0, Hud::WIDTH * 2, Hud::HEIGHT * 2};
+    SDL_Texture *hudTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, Hud::WIDTH, Hud::HEIGHT);
+    SDL_SetTextureBlendMode(hudTexture, SDL_BLENDMODE_BLEND);
+
     uint32_t pixels[2048];
+    uint8_t keys[16] = {0};
     Chip8 chip8;
 
-    chip8.LoadRom("../roms/PONG");
+    chip8.SetQuirks(quirks);
+    chip8.SetBounds(bounds);
+    chip8.LoadRom(romPath);
+
+#ifdef CHIP8_PROFILE
+    Profiler profiler;
+    if (!profilePrefix.empty()) chip8.AttachProfiler(&profiler);
+#endif
+
+#ifdef CHIP8_TRACK_MEMORY
+    MemoryTracker tracker(true);
+    if (!memoryMapPrefix.empty()) chip8.AttachMemoryTracker(&tracker);
+#endif
+
+    // Leave one core for the frontend itself
+    RunAhead* speculation = nullptr;
+    if (runAhead && !netplay) speculation = new RunAhead((int)std::thread::hardware_concurrency() - 1);
+
+    RollbackSession* session = nullptr;
+    if (netplay) session = new RollbackSession(chip8, transport, netPlayers, netPlayer, inputDelay);
+
+    Metrics& metrics = Metrics::Instance();
+    if (!metricsTarget.empty()) metrics.Start(metricsTarget, metricsInterval);
+
+    const std::chrono::microseconds framePeriod(1200 * Chip8::CYCLES_PER_FRAME);
+    std::chrono::steady_clock::time_point nextFrame = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point frameStart = nextFrame;
 
     while (isRunning)
     {
         SDL_Event e;
+        std::chrono::steady_clock::time_point stageStart = std::chrono::steady_clock::now();
+        uint64_t instructions = 0;
+        uint64_t presentNs = 0;
 
         // Poll Keyboard
         while (SDL_PollEvent(&e))
@@ -72,10 +229,19 @@ int main(int argc, char* args[])
 
             if (e.type == SDL_KEYDOWN)
             {
+                if (e.key.keysym.sym == SDLK_F1 && !e.key.repeat)
+                {
+                    hud.visible = !hud.visible;
+                    chip8.drawFlag = true;
+                }
+
                 for (int i = 0; i < 16; i++)
                 {
-                    if (e.key.keysym.sym == keymap[i])
-                        chip8.key[i] = 1;
+                    if (e.key.keysym.sym == keymap[i] && keys[i] == 0)
+                    {
+                        keys[i] = 1;
+                        CHIP8_PROBE2(key, i, 1);
+                    }
                 }
             }
 
@@ -83,36 +249,122 @@ int main(int argc, char* args[])
             {
                 for (int i = 0; i < 16; i++)
                 {
-                    if (e.key.keysym.sym == keymap[i])
-                        chip8.key[i] = 0;
+                    if (e.key.keysym.sym == keymap[i] && keys[i] == 1)
+                    {
+                        keys[i] = 0;
+                        CHIP8_PROBE2(key, i, 0);
+                    }
                 }
             }
         }
 
-        // Run a clock cycle
-        chip8.Update();
+        if (session != nullptr)
+        {
+            uint16_t mask = 0;
+            for (int i = 0; i < 16; i++) mask |= keys[i] << i;
 
-        // If previous clock cycle set draw flag, draw to the screen
-        if (chip8.drawFlag)
+            // Keep in step with the peers: sit out a frame rather than run further ahead on predictions,
+            // still taking in their inputs. A stalled frame runs no instructions
+            if (session->FramesAhead() <= 1)
+            {
+                if (session->AdvanceFrame(mask)) instructions = Chip8::CYCLES_PER_FRAME;
+            } else {
+                session->Poll();
+            }
+        } else {
+            for (int i = 0; i < 16; i++) chip8.key[i] = keys[i];
+
+            // Run a frame, or adopt the one the run-ahead workers already emulated for this input
+            if (speculation == nullptr || !speculation->Take(chip8.key, chip8)) chip8.RunFrame();
+            if (speculation != nullptr) speculation->Speculate(chip8);
+            instructions = Chip8::CYCLES_PER_FRAME;
+        }
+        metrics.AddInstructions(instructions);
+        stageStart = StageDone(metrics, Metrics::EMULATE, stageStart);
+
+        // If previous clock cycle set draw flag, draw to the screen; the overlay redraws every frame while shown
+        if (chip8.drawFlag || hud.visible)
         {
             // Store pixels in temporary buffer
             for (int i = 0; i < 2048; ++i) {
                 uint8_t pixel = chip8.display[i];
                 pixels[i] = (0x00FFFFFF * pixel) | 0xFF000000; // Makes 1 = 0xFFFFFFFF and 0 = 0xFF000000
             }
+            stageStart = StageDone(metrics, Metrics::CONVERT, stageStart);
 
             // Update SDL texture
             SDL_UpdateTexture(sdlTexture, nullptr, pixels, 64 * sizeof(Uint32));
+            stageStart = StageDone(metrics, Metrics::UPLOAD, stageStart);
+
+            if (hud.visible)
+            {
+                hud.Render(hudPixels);
+                SDL_UpdateTexture(hudTexture, nullptr, hudPixels, Hud::WIDTH * sizeof(Uint32));
+                stageStart = StageDone(metrics, Metrics::UPLOAD, stageStart);
+            }
+
             // Clear screen and render
+            std::chrono::steady_clock::time_point presentStart = stageStart;
             SDL_RenderClear(renderer);
             SDL_RenderCopy(renderer, sdlTexture, nullptr, nullptr);
+            if (hud.visible) SDL_RenderCopy(renderer, hudTexture, nullptr, &hudRect);
             SDL_RenderPresent(renderer);
+            stageStart = StageDone(metrics, Metrics::PRESENT, stageStart);
+            presentNs = std::chrono::duration_cast<std::chrono::nanoseconds>(stageStart - presentStart).count();
+            metrics.FramePresented();
 
             chip8.drawFlag = false;
         }
 
-        std::this_thread::sleep_for(std::chrono::microseconds(1200));
+        // A frame that overran its whole slot is dropped from the schedule instead of being caught up
+        nextFrame += framePeriod;
+        if (stageStart > nextFrame + framePeriod)
+        {
+            metrics.FrameDropped();
+            nextFrame = stageStart;
+        }
+        std::chrono::steady_clock::time_point idleStart = stageStart;
+        std::this_thread::sleep_until(nextFrame);
+        stageStart = StageDone(metrics, Metrics::IDLE, stageStart);
+
+        uint64_t frameNs = std::chrono::duration_cast<std::chrono::nanoseconds>(stageStart - frameStart).count();
+        metrics.FrameTime(frameNs);
+        hud.Frame(frameNs, presentNs, std::chrono::duration_cast<std::chrono::nanoseconds>(stageStart - idleStart).count(), instructions);
+        frameStart = stageStart;
+    }
+
+    metrics.Stop();
+
+    delete speculation;
+    speculation = nullptr;
+
+    delete session;
+    session = nullptr;
+
+#ifdef CHIP8_PROFILE
+    if (!profilePrefix.empty())
+    {
+        std::ofstream report((profilePrefix + ".txt").c_str());
+        profiler.WriteReport(report);
+
+        std::ofstream folded((profilePrefix + ".folded").c_str());
+        profiler.WriteFoldedStacks(folded);
     }
+#endif
+
+#ifdef CHIP8_TRACK_MEMORY
+    if (!memoryMapPrefix.empty())
+    {
+        std::ofstream csv((memoryMapPrefix + ".csv").c_str());
+        tracker.WriteCsv(csv);
+
+        std::ofstream image((memoryMapPrefix + ".ppm").c_str(), std::ios::binary);
+        tracker.WriteImage(image, 8);
+    }
+#endif
+
+    SDL_DestroyTexture(hudTexture);
+    hudTexture = nullptr;
 
     SDL_DestroyTexture(sdlTexture);
     sdlTexture = nullptr;
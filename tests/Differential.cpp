@@ -0,0 +1,382 @@
+/*
+ * chip8_diff: lockstep differential test between execution engines. Runs the reference engine
+ * and a candidate side by side on every ROM with the same scripted input, compares the full
+ * machine state every interval, and on a mismatch bisects back to the first instruction after
+ * which the two machines differ and prints both states. Every HASH_CHECK_EVERY checks, and at the
+ * end, the candidate's StateHash, whose memory and display parts are kept up incrementally, must
+ * also match a full rehash.
+ *
+ * Usage: chip8_diff [--roms <dir>] [--engine <name>|all] [--quirks <profile>|all] [--bounds <mode>|all]
+ *                   [--cycles <n>] [--interval <n>] [--threads <n>] [--switch <n>]
+ * --engine all (the default) checks every registered engine, including the reference against
+ * itself, which catches nondeterminism in the core, plus predecode-fused, the predecode engine
+ * with every superinstruction on. Besides the ROMs, a few directed programs built in below run
+ * the same way. --quirks runs both machines under a quirk
+ * profile (default: default), or under each profile in turn; --bounds likewise with a bounds mode
+ * (default: wrap). --switch <n> starts both machines under the next profile and mode, switches the
+ * bounds mode to the one being tested after n instructions and the profile after 2n, without
+ * resetting the engines, which must then drop whatever they decoded for the old ones.
+ */
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <string.h>
+
+#include "Chip8.h"
+#include "Engine.h"
+#include "PredecodeEngine.h"
+#include "RomScript.h"
+
+// Programs for paths the ROMs do not reach, run under every engine alongside them
+struct Program
+{
+    const char* name;
+    uint8_t image[8];
+    size_t size;
+};
+
+static const Program programs[] = {
+    // Annn;Dxyn drawing past the end of memory from the I it just set, then looping: under
+    // BOUNDS_FAULT the draw must halt the machine even when the pair runs fused
+    {"directed:annn-dxyn-past-end", {0xAF, 0xFE, 0xD0, 0x05, 0x12, 0x00}, 6},
+};
+
+// The trained predecode engine only fuses what a ROM runs often; this one fuses from the start
+static std::unique_ptr<Engine> MakeFusedPredecode()
+{
+    return std::unique_ptr<Engine>(new PredecodeEngine(PredecodeEngine::ALL_FUSIONS));
+}
+
+static const Engine::Info fusedPredecode = {"predecode-fused", "predecode with every superinstruction enabled",
+                                            &MakeFusedPredecode};
+
+// A full rehash costs about as much as the instructions between two checks, so only some get one
+static const int HASH_CHECK_EVERY = 16;
+
+struct Job
+{
+    std::string rom;
+    const Program* program;
+    const Engine::Info* engine;
+    QuirkProfile quirks;
+    BoundsMode bounds;
+    long switchAt;
+    bool passed;
+    std::string report;
+};
+
+// Executes instructions [from, to), changing input at frame boundaries as RunFrame callers do and
+// switching to the job's bounds mode and then its profile at their switch points
+static void Advance(Chip8& chip8, Engine& engine, const Job& job, long from, long to)
+{
+    while (from < to)
+    {
+        long frame = from / Chip8::CYCLES_PER_FRAME;
+        if (from % Chip8::CYCLES_PER_FRAME == 0) ScriptInput(chip8, frame);
+        if (job.switchAt > 0 && from == job.switchAt) chip8.SetBounds(job.bounds);
+        if (job.switchAt > 0 && from == 2 * job.switchAt) chip8.SetQuirks(job.quirks);
+
+        long end = std::min(to, (frame + 1) * Chip8::CYCLES_PER_FRAME);
+        if (from < job.switchAt) end = std::min(end, job.switchAt);
+        else if (from < 2 * job.switchAt) end = std::min(end, 2 * job.switchAt);
+        engine.Run(chip8, end - from);
+        from = end;
+    }
+}
+
+static bool Same(const Chip8& a, const Chip8& b)
+{
+    for (int i = 0; i < 16; i++)
+    {
+        if (a.Register(i) != b.Register(i) || a.StackEntry(i) != b.StackEntry(i)) return false;
+    }
+    return a.IndexRegister() == b.IndexRegister() && a.ProgramCounter() == b.ProgramCounter()
+           && a.StackPointer() == b.StackPointer() && a.DelayTimer() == b.DelayTimer()
+           && a.SoundTimer() == b.SoundTimer() && a.MemoryHash() == b.MemoryHash()
+           && a.DisplayHash() == b.DisplayHash() && memcmp(a.display, b.display, sizeof(a.display)) == 0
+           && a.StateHash() == b.StateHash();
+}
+
+static void Dump(std::ostream& out, const char* label, const Chip8& chip8)
+{
+    out << "  " << std::left << std::setw(12) << label << std::right;
+    out << std::hex << std::uppercase << std::setfill('0');
+    out << ": pc=" << std::setw(3) << chip8.ProgramCounter()
+        << " I=" << std::setw(3) << chip8.IndexRegister()
+        << " sp=" << (int)chip8.StackPointer()
+        << " DT=" << std::setw(2) << (int)chip8.DelayTimer()
+        << " ST=" << std::setw(2) << (int)chip8.SoundTimer() << "\n    V:";
+    for (int i = 0; i < 16; i++) out << " " << std::setw(2) << (int)chip8.Register(i);
+    out << "\n    stack:";
+    for (int i = 0; i < 16; i++) out << " " << std::setw(3) << chip8.StackEntry(i);
+    out << "\n    memory hash " << std::setw(16) << chip8.MemoryHash()
+        << ", display hash " << std::setw(16) << chip8.DisplayHash()
+        << ", state hash " << std::setw(16) << chip8.StateHash() << "\n";
+    out << std::dec << std::nouppercase << std::setfill(' ');
+    if (chip8.CurrentFault() != Chip8::FAULT_NONE) out << "    halted: " << Chip8::FaultName(chip8.CurrentFault()) << "\n";
+}
+
+static void DumpDifferences(std::ostream& out, const Chip8& a, const Chip8& b)
+{
+    int shown = 0;
+    int differing = 0;
+    for (int address = 0; address < 4096; address++)
+    {
+        if (a.Read(address) == b.Read(address)) continue;
+        if (shown++ < 16)
+        {
+            out << std::hex << std::uppercase << std::setfill('0') << "    mem[" << std::setw(3) << address << "] "
+                << std::setw(2) << (int)a.Read(address) << " vs " << std::setw(2) << (int)b.Read(address)
+                << std::dec << std::nouppercase << std::setfill(' ') << "\n";
+        }
+        differing++;
+    }
+
+    int pixels = 0;
+    for (int i = 0; i < 2048; i++) pixels += a.display[i] != b.display[i];
+
+    out << "    " << differing << " memory bytes and " << pixels << " pixels differ\n";
+}
+
+/*
+ * Runs the reference and the candidate until `cycles`, checking every `interval` instructions.
+ * On a mismatch both machines are restored from the last matching check and re-run with fresh
+ * engines, halving the window until it is a single instruction.
+ */
+static void RunJob(Job& job, const std::string& romDir, long cycles, long interval)
+{
+    Chip8 loaded;
+    bool loadedRom = job.program != nullptr ? loaded.LoadRom(job.program->image, job.program->size)
+                                            : loaded.LoadRom((romDir + "/" + job.rom).c_str());
+    if (!loadedRom)
+    {
+        job.passed = false;
+        job.report = "failed to load\n";
+        return;
+    }
+    if (job.switchAt > 0)
+    {
+        loaded.SetQuirks((QuirkProfile)((job.quirks + 1) % QUIRK_PROFILE_COUNT));
+        loaded.SetBounds((BoundsMode)((job.bounds + 1) % BOUNDS_MODE_COUNT));
+    }
+    else
+    {
+        loaded.SetQuirks(job.quirks);
+        loaded.SetBounds(job.bounds);
+    }
+
+    Chip8 reference = loaded.Clone();
+    Chip8 candidate = loaded.Clone();
+    std::unique_ptr<Engine> referenceEngine(new ReferenceEngine());
+    std::unique_ptr<Engine> candidateEngine = job.engine->create();
+
+    Chip8 goodReference = reference.Clone();
+    Chip8 goodCandidate = candidate.Clone();
+    long good = 0;
+    long bad = -1;
+    long checks = 0;
+
+    for (long executed = 0; executed < cycles && bad < 0;)
+    {
+        long next = std::min(cycles, executed + interval);
+        Advance(reference, *referenceEngine, job, executed, next);
+        Advance(candidate, *candidateEngine, job, executed, next);
+        executed = next;
+
+        bool rehash = ++checks % HASH_CHECK_EVERY == 0 || executed == cycles;
+        if (rehash && candidate.StateHash() != candidate.RecomputeStateHash())
+        {
+            std::ostringstream report;
+            report << "incremental StateHash differs from a full rehash after " << executed << " instructions (frame "
+                   << executed / Chip8::CYCLES_PER_FRAME << ")\n";
+            Dump(report, job.engine->name, candidate);
+            job.passed = false;
+            job.report = report.str();
+            return;
+        }
+
+        if (Same(reference, candidate))
+        {
+            goodReference = reference.Clone();
+            goodCandidate = candidate.Clone();
+            good = executed;
+        }
+        else bad = executed;
+    }
+
+    if (bad < 0)
+    {
+        job.passed = true;
+        return;
+    }
+
+    while (bad - good > 1)
+    {
+        long middle = good + (bad - good) / 2;
+
+        Chip8 probeReference = goodReference.Clone();
+        Chip8 probeCandidate = goodCandidate.Clone();
+        ReferenceEngine probeReferenceEngine;
+        std::unique_ptr<Engine> probeCandidateEngine = job.engine->create();
+        Advance(probeReference, probeReferenceEngine, job, good, middle);
+        Advance(probeCandidate, *probeCandidateEngine, job, good, middle);
+
+        if (Same(probeReference, probeCandidate))
+        {
+            goodReference = probeReference;
+            goodCandidate = probeCandidate;
+            good = middle;
+        }
+        else bad = middle;
+    }
+
+    // Replay the one diverging instruction from the last state both engines agree on
+    Chip8 afterReference = goodReference.Clone();
+    Chip8 afterCandidate = goodCandidate.Clone();
+    ReferenceEngine lastReferenceEngine;
+    std::unique_ptr<Engine> lastCandidateEngine = job.engine->create();
+    Advance(afterReference, lastReferenceEngine, job, good, bad);
+    Advance(afterCandidate, *lastCandidateEngine, job, good, bad);
+
+    uint16_t pc = goodReference.ProgramCounter();
+    std::ostringstream report;
+    report << "diverged at instruction " << good << " (frame " << good / Chip8::CYCLES_PER_FRAME << "), opcode "
+           << std::hex << std::uppercase << std::setfill('0') << std::setw(2) << (int)goodReference.Read(pc)
+           << std::setw(2) << (int)goodReference.Read(pc + 1) << " at " << std::setw(3) << pc
+           << std::dec << std::nouppercase << std::setfill(' ') << "\n";
+    Dump(report, "before", goodReference);
+    Dump(report, "reference", afterReference);
+    Dump(report, job.engine->name, afterCandidate);
+    DumpDifferences(report, afterReference, afterCandidate);
+
+    job.passed = false;
+    job.report = report.str();
+}
+
+int main(int argc, char* args[])
+{
+    std::string romDir = "roms";
+    std::string engineName = "all";
+    std::string quirksName = "default";
+    std::string boundsName = "wrap";
+    long cycles = 2000000;
+    long interval = 1000;
+    long switchAt = 0;
+    int threadCount = (int)std::thread::hardware_concurrency();
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(args[i], "--roms") == 0) romDir = args[i + 1];
+        else if (strcmp(args[i], "--engine") == 0) engineName = args[i + 1];
+        else if (strcmp(args[i], "--quirks") == 0) quirksName = args[i + 1];
+        else if (strcmp(args[i], "--bounds") == 0) boundsName = args[i + 1];
+        else if (strcmp(args[i], "--cycles") == 0) cycles = atol(args[i + 1]);
+        else if (strcmp(args[i], "--interval") == 0) interval = atol(args[i + 1]);
+        else if (strcmp(args[i], "--threads") == 0) threadCount = atoi(args[i + 1]);
+        else if (strcmp(args[i], "--switch") == 0) switchAt = atol(args[i + 1]);
+    }
+    if (threadCount < 1) threadCount = 1;
+    if (interval < 1) interval = 1;
+
+    std::vector<const Engine::Info*> engines;
+    const std::vector<Engine::Info>& all = Engine::All();
+    for (size_t e = 0; e < all.size(); e++)
+    {
+        if (engineName == "all" || engineName == all[e].name) engines.push_back(&all[e]);
+    }
+    if (engineName == "all" || engineName == fusedPredecode.name) engines.push_back(&fusedPredecode);
+    if (engines.empty())
+    {
+        std::cerr << "Unknown engine " << engineName << "; available:";
+        for (size_t e = 0; e < all.size(); e++) std::cerr << " " << all[e].name;
+        std::cerr << " " << fusedPredecode.name << std::endl;
+        return 1;
+    }
+
+    std::vector<QuirkProfile> profiles;
+    for (int q = 0; q < QUIRK_PROFILE_COUNT; q++)
+    {
+        if (quirksName == "all" || quirksName == QuirkProfileName((QuirkProfile)q)) profiles.push_back((QuirkProfile)q);
+    }
+    if (profiles.empty())
+    {
+        std::cerr << "Unknown quirk profile " << quirksName << "; available:";
+        for (int q = 0; q < QUIRK_PROFILE_COUNT; q++) std::cerr << " " << QuirkProfileName((QuirkProfile)q);
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    std::vector<BoundsMode> modes;
+    for (int b = 0; b < BOUNDS_MODE_COUNT; b++)
+    {
+        if (boundsName == "all" || boundsName == BoundsModeName((BoundsMode)b)) modes.push_back((BoundsMode)b);
+    }
+    if (modes.empty())
+    {
+        std::cerr << "Unknown bounds mode " << boundsName << "; available: wrap fault" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> names;
+    if (!ListRoms(romDir, names))
+    {
+        std::cerr << "Failed to open ROM directory " << romDir << std::endl;
+        return 1;
+    }
+
+    std::vector<Job> jobs;
+    for (size_t b = 0; b < modes.size(); b++)
+    {
+        for (size_t q = 0; q < profiles.size(); q++)
+        {
+            for (size_t e = 0; e < engines.size(); e++)
+            {
+                for (size_t n = 0; n < names.size() + sizeof(programs) / sizeof(programs[0]); n++)
+                {
+                    Job job;
+                    job.program = n < names.size() ? nullptr : &programs[n - names.size()];
+                    job.rom = job.program != nullptr ? job.program->name : names[n];
+                    job.engine = engines[e];
+                    job.quirks = profiles[q];
+                    job.bounds = modes[b];
+                    job.switchAt = switchAt;
+                    job.passed = false;
+                    jobs.push_back(job);
+                }
+            }
+        }
+    }
+
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threadCount; t++)
+    {
+        workers.push_back(std::thread([&]() {
+            size_t j;
+            while ((j = next++) < jobs.size()) RunJob(jobs[j], romDir, cycles, interval);
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+
+    int failures = 0;
+    for (size_t j = 0; j < jobs.size(); j++)
+    {
+        if (jobs[j].passed) continue;
+        std::cout << "FAIL " << jobs[j].engine->name << " " << jobs[j].rom;
+        if (jobs[j].quirks != QUIRKS_DEFAULT) std::cout << " (" << QuirkProfileName(jobs[j].quirks) << " quirks)";
+        if (jobs[j].bounds != BOUNDS_WRAP) std::cout << " (" << BoundsModeName(jobs[j].bounds) << " on out-of-range)";
+        if (jobs[j].switchAt > 0) std::cout << " (switched to after " << jobs[j].switchAt << " and " << 2 * jobs[j].switchAt << " instructions)";
+        std::cout << ": " << jobs[j].report;
+        failures++;
+    }
+
+    std::cout << jobs.size() - failures << "/" << jobs.size() << " engine/ROM pairs match the reference over "
+              << cycles << " instructions" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
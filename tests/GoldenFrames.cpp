@@ -0,0 +1,217 @@
+/*
+ * chip8_golden: golden-frame regression test. Runs every ROM in a directory headless with
+ * scripted input, hashes the display and the whole machine state at fixed frame checkpoints, and
+ * compares them against committed golden values. ROMs run concurrently, one per worker thread.
+ *
+ * Usage: chip8_golden [--roms <dir>] [--golden <file>] [--threads <n>] [--update]
+ * --update rewrites the golden file from the current core instead of comparing against it.
+ *
+ * The core is fully deterministic: Init seeds the Cxkk generator with a fixed value, and input
+ * comes from the script below, so any hash change is a behavior change.
+ */
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+
+#include "Chip8.h"
+#include "RomScript.h"
+
+static const long CHECKPOINTS[] = {1, 10, 60, 300, 1000, 3000, 6000, 10000};
+static const int CHECKPOINT_COUNT = sizeof(CHECKPOINTS) / sizeof(CHECKPOINTS[0]);
+
+struct Checkpoint
+{
+    long frame;
+    uint64_t display;
+    uint64_t state;
+};
+
+// FNV-1a over the framebuffer, kept apart from StateHash so a report says whether the picture changed
+static uint64_t DisplayHash(const Chip8& chip8)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < 2048; i++)
+    {
+        hash ^= chip8.display[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static bool Run(const std::string& path, std::vector<Checkpoint>& checkpoints)
+{
+    Chip8 chip8;
+    if (!chip8.LoadRom(path.c_str())) return false;
+
+    long frame = 0;
+    for (int c = 0; c < CHECKPOINT_COUNT; c++)
+    {
+        for (; frame < CHECKPOINTS[c]; frame++)
+        {
+            ScriptInput(chip8, frame);
+            chip8.RunFrame();
+        }
+
+        Checkpoint checkpoint;
+        checkpoint.frame = frame;
+        checkpoint.display = DisplayHash(chip8);
+        checkpoint.state = chip8.StateHash();
+        checkpoints.push_back(checkpoint);
+    }
+    return true;
+}
+
+// Golden file lines: <rom> <frame> <display hash> <state hash>, hashes in hex; '#' starts a comment
+static bool ReadGolden(const std::string& path, std::map<std::string, std::vector<Checkpoint> >& golden)
+{
+    std::ifstream file(path.c_str());
+    if (!file) return false;
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream fields(line);
+        std::string rom;
+        Checkpoint checkpoint;
+        fields >> rom >> checkpoint.frame >> std::hex >> checkpoint.display >> checkpoint.state;
+        if (fields.fail())
+        {
+            std::cerr << "Malformed golden line: " << line << std::endl;
+            return false;
+        }
+        golden[rom].push_back(checkpoint);
+    }
+    return true;
+}
+
+static bool WriteGolden(const std::string& path, const std::vector<std::string>& names,
+                        const std::vector<std::vector<Checkpoint> >& results)
+{
+    std::ofstream file(path.c_str());
+    if (!file) return false;
+
+    file << "# Generated by chip8_golden --update: <rom> <frame> <display hash> <state hash>\n";
+    for (size_t n = 0; n < names.size(); n++)
+    {
+        for (size_t c = 0; c < results[n].size(); c++)
+        {
+            const Checkpoint& checkpoint = results[n][c];
+            file << names[n] << " " << checkpoint.frame << std::hex << std::setfill('0')
+                 << " " << std::setw(16) << checkpoint.display << " " << std::setw(16) << checkpoint.state
+                 << std::dec << "\n";
+        }
+    }
+    return file.good();
+}
+
+int main(int argc, char* args[])
+{
+    std::string romDir = "roms";
+    std::string goldenPath = "tests/golden_frames.txt";
+    int threadCount = (int)std::thread::hardware_concurrency();
+    bool update = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(args[i], "--update") == 0) update = true;
+        else if (strcmp(args[i], "--roms") == 0 && i + 1 < argc) romDir = args[++i];
+        else if (strcmp(args[i], "--golden") == 0 && i + 1 < argc) goldenPath = args[++i];
+        else if (strcmp(args[i], "--threads") == 0 && i + 1 < argc) threadCount = atoi(args[++i]);
+    }
+    if (threadCount < 1) threadCount = 1;
+
+    std::vector<std::string> names;
+    if (!ListRoms(romDir, names))
+    {
+        std::cerr << "Failed to open ROM directory " << romDir << std::endl;
+        return 1;
+    }
+
+    // Workers pull ROMs off a shared index; each ROM's results land in its own slot
+    std::vector<std::vector<Checkpoint> > results(names.size());
+    std::vector<char> loaded(names.size(), 0);
+    std::atomic<size_t> next(0);
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threadCount; t++)
+    {
+        workers.push_back(std::thread([&]() {
+            size_t n;
+            while ((n = next++) < names.size()) loaded[n] = Run(romDir + "/" + names[n], results[n]);
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+
+    for (size_t n = 0; n < names.size(); n++)
+    {
+        if (!loaded[n])
+        {
+            std::cerr << "Failed to load " << names[n] << std::endl;
+            return 1;
+        }
+    }
+
+    if (update)
+    {
+        if (!WriteGolden(goldenPath, names, results))
+        {
+            std::cerr << "Failed to write " << goldenPath << std::endl;
+            return 1;
+        }
+        std::cout << "Wrote " << names.size() << " ROMs to " << goldenPath << std::endl;
+        return 0;
+    }
+
+    std::map<std::string, std::vector<Checkpoint> > golden;
+    if (!ReadGolden(goldenPath, golden))
+    {
+        std::cerr << "Failed to read " << goldenPath << "; run with --update to create it" << std::endl;
+        return 1;
+    }
+
+    // Report only the first diverging checkpoint per ROM; later ones follow from it
+    int failures = 0;
+    for (size_t n = 0; n < names.size(); n++)
+    {
+        std::map<std::string, std::vector<Checkpoint> >::const_iterator expected = golden.find(names[n]);
+        if (expected == golden.end())
+        {
+            std::cout << "FAIL " << names[n] << ": no golden values" << std::endl;
+            failures++;
+            continue;
+        }
+
+        for (size_t c = 0; c < results[n].size(); c++)
+        {
+            const Checkpoint& actual = results[n][c];
+            const Checkpoint* want = nullptr;
+            for (size_t g = 0; g < expected->second.size(); g++)
+            {
+                if (expected->second[g].frame == actual.frame) want = &expected->second[g];
+            }
+
+            if (want == nullptr || want->display != actual.display || want->state != actual.state)
+            {
+                std::cout << "FAIL " << names[n] << " at frame " << actual.frame << ": "
+                          << (want == nullptr ? "no golden checkpoint" : want->display != actual.display ? "display differs" : "state differs")
+                          << std::endl;
+                failures++;
+                break;
+            }
+        }
+    }
+
+    std::cout << names.size() - failures << "/" << names.size() << " ROMs match " << goldenPath << std::endl;
+    return failures == 0 ? 0 : 1;
+}
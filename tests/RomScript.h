@@ -0,0 +1,37 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+
+#include "Chip8.h"
+
+/*
+ * How chip8_golden, chip8_diff, chip8_runahead and chip8_bench find ROMs and drive them, kept in one
+ * place so all of them run the same ROMs on the same input
+ */
+
+// Holds key (frame / 20) % 16 for ten frames, then nothing for ten, so menus and games make progress
+inline void ScriptInput(Chip8& chip8, long frame)
+{
+    int held = (frame % 20) < 10 ? (int)((frame / 20) % 16) : -1;
+    for (int i = 0; i < 16; i++) chip8.key[i] = i == held;
+}
+
+// The names of the files in `dir` not starting with '.', sorted; false if it cannot be opened
+inline bool ListRoms(const std::string& dir, std::vector<std::string>& names)
+{
+    DIR* handle = opendir(dir.c_str());
+    if (handle == nullptr) return false;
+
+    names.clear();
+    for (dirent* entry = readdir(handle); entry != nullptr; entry = readdir(handle))
+    {
+        if (entry->d_name[0] != '.') names.push_back(entry->d_name);
+    }
+    closedir(handle);
+    std::sort(names.begin(), names.end());
+    return true;
+}
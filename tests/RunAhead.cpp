@@ -0,0 +1,81 @@
+/*
+ * chip8_runahead: checks that a frame adopted from RunAhead is the frame the machine would have
+ * run itself. Every ROM runs twice with the scripted input, once frame by frame and once the way
+ * the frontend does with run-ahead on, adopting each frame with Take and speculating on the next;
+ * after every frame the two must agree on StateHash, the display and drawFlag.
+ *
+ * Usage: chip8_runahead [--roms <dir>] [--frames <n>] [--threads <n>]
+ */
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "Chip8.h"
+#include "RomScript.h"
+#include "RunAhead.h"
+
+static bool Run(const std::string& path, long frames, int threads)
+{
+    Chip8 direct;
+    if (!direct.LoadRom(path.c_str())) return false;
+    Chip8 adopted = direct.Clone();
+
+    RunAhead speculation(threads);
+    speculation.Speculate(adopted);
+
+    for (long frame = 0; frame < frames; frame++)
+    {
+        ScriptInput(direct, frame);
+        direct.RunFrame();
+
+        // The script toggles at most one key between frames, so a candidate always matches once it is done
+        ScriptInput(adopted, frame);
+        while (!speculation.Take(adopted.key, adopted)) std::this_thread::yield();
+        speculation.Speculate(adopted);
+
+        if (adopted.StateHash() != direct.StateHash() || adopted.drawFlag != direct.drawFlag ||
+            memcmp(adopted.display, direct.display, sizeof(direct.display)) != 0)
+        {
+            std::cerr << "FAIL " << path << ": frame " << frame << " from run-ahead differs from running it directly"
+                      << (adopted.drawFlag != direct.drawFlag ? " (drawFlag)" : "") << std::endl;
+            return false;
+        }
+
+        // Presenting clears the flag, as the frontend does
+        direct.drawFlag = false;
+        adopted.drawFlag = false;
+    }
+    return true;
+}
+
+int main(int argc, char* args[])
+{
+    std::string romDir = "roms";
+    long frames = 300;
+    int threads = 4;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(args[i], "--roms") == 0) romDir = args[i + 1];
+        else if (strcmp(args[i], "--frames") == 0) frames = atol(args[i + 1]);
+        else if (strcmp(args[i], "--threads") == 0) threads = atoi(args[i + 1]);
+    }
+
+    std::vector<std::string> names;
+    if (!ListRoms(romDir, names))
+    {
+        std::cerr << "Failed to open ROM directory " << romDir << std::endl;
+        return 1;
+    }
+
+    int failures = 0;
+    for (size_t n = 0; n < names.size(); n++) failures += !Run(romDir + "/" + names[n], frames, threads);
+
+    std::cout << names.size() - failures << "/" << names.size() << " ROMs match with run-ahead over " << frames
+              << " frames" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,96 @@
+/*
+ * chip8_search_test: StateSearch on a directed program whose shortest solution is known. The
+ * program adds one to V0 each time key 5 goes down and waits for it to come up again, so V0 == 3
+ * takes five frames (press, release, press, release, press). Every other input leaves the machine
+ * where it would be with nothing held, so most children are duplicates that must be dropped.
+ *
+ * Usage: chip8_search_test [--threads <n>]
+ */
+#include <iostream>
+#include <vector>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Chip8.h"
+#include "Search.h"
+
+static const uint8_t program[] = {
+    0x61, 0x05, // 200: LD V1, 5
+    0xE1, 0x9E, // 202: SKP V1
+    0x12, 0x02, // 204: JP 0x202
+    0x70, 0x01, // 206: ADD V0, 1
+    0xE1, 0xA1, // 208: SKNP V1
+    0x12, 0x08, // 20A: JP 0x208
+    0x12, 0x02, // 20C: JP 0x202
+};
+
+static const int SHORTEST = 5;
+
+static bool Check(StateSearch& search, const Chip8& start, const char* name)
+{
+    std::vector<int> inputs;
+    StateSearch::Goal goal = [](const Chip8& state) { return state.Register(0) == 3; };
+    if (!search.Run(start, goal, inputs))
+    {
+        std::cerr << "FAIL " << name << ": goal not found" << std::endl;
+        return false;
+    }
+
+    if (inputs.size() != SHORTEST && search.mode == StateSearch::BREADTH_FIRST)
+    {
+        std::cerr << "FAIL " << name << ": " << inputs.size() << " frames, shortest is " << SHORTEST << std::endl;
+        return false;
+    }
+
+    // The inputs found have to reach the goal when played back
+    Chip8 replay = start.Clone();
+    for (size_t f = 0; f < inputs.size(); f++)
+    {
+        for (int k = 0; k < 16; k++) replay.key[k] = k == inputs[f];
+        replay.RunFrame();
+    }
+    if (!goal(replay))
+    {
+        std::cerr << "FAIL " << name << ": the inputs found do not reach the goal on replay" << std::endl;
+        return false;
+    }
+
+    // Each frame only has two distinct outcomes, so all but a handful of the 17 children per state
+    // must be dropped, and the search must not expand more states than the depth allows
+    size_t children = 17 * search.expanded;
+    if (search.duplicates * 10 < children * 8 || search.expanded > 4 * SHORTEST)
+    {
+        std::cerr << "FAIL " << name << ": expanded " << search.expanded << " states and dropped "
+                  << search.duplicates << " of " << children << " children" << std::endl;
+        return false;
+    }
+
+    std::cout << "PASS " << name << ": " << inputs.size() << " frames, expanded " << search.expanded << ", dropped "
+              << search.duplicates << " duplicates" << std::endl;
+    return true;
+}
+
+int main(int argc, char** args)
+{
+    int threads = 4;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(args[i], "--threads") == 0) threads = atoi(args[i + 1]);
+    }
+
+    Chip8 start;
+    if (!start.LoadRom(program, sizeof(program))) return 1;
+
+    // The same search object twice, so workers started for one run do not leak into the next
+    StateSearch search(threads);
+    bool passed = Check(search, start, "breadth-first");
+    passed = Check(search, start, "breadth-first again") && passed;
+
+    search.mode = StateSearch::BEST_FIRST;
+    search.heuristic = [](const Chip8& state) { return 3 - state.Register(0); };
+    passed = Check(search, start, "best-first") && passed;
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,250 @@
+/*
+ * chip8_disasm: disassembles a ROM by recursive descent from 0x200 (see Analysis.h) and writes a
+ * listing to stdout and, with --cfg, the control-flow graph as JSON.
+ *
+ * Usage: chip8_disasm --rom <path> [--cfg <path>]
+ *
+ * The listing has one line per instruction with its address, opcode and mnemonic, a label before
+ * every block (sub_ for subroutines, loop_ for loop heads, block_ otherwise) and notes on skipped
+ * instructions, indirect jumps and stores. Data is listed as bytes, sprites one row per line with
+ * its pixels. An instruction that overlaps the one before it is only in the CFG.
+ */
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Analysis.h"
+#include "Instructions.h"
+
+static std::string Hex(int value, int digits)
+{
+    char text[16];
+    snprintf(text, sizeof(text), "0x%0*X", digits, value);
+    return text;
+}
+
+static std::string Label(const ControlFlowGraph& graph, uint16_t address)
+{
+    const char* prefix = graph.IsSubroutine(address) ? "sub_" : graph.IsLoopHeader(address) ? "loop_" : "block_";
+    return prefix + Hex(address, 3);
+}
+
+// What the listing says about the instruction at `address` beyond its mnemonic
+static std::string Notes(const ControlFlowGraph& graph, uint16_t address, const ControlFlowGraph::Store* store)
+{
+    std::string notes;
+    if (graph.IsSkipGuarded(address)) notes += "; may be skipped ";
+    if (Instructions::Decode(graph.Opcode(address)) == Instructions::JP_BNNN) notes += "; indirect jump ";
+    if (store != nullptr)
+    {
+        if (!store->known) notes += "; store to an unknown address ";
+        else if (store->hitsCode) notes += "; modifies code at " + Hex(store->target, 3) + " ";
+        else notes += "; store to " + Hex(store->target, 3) + " ";
+    }
+    return notes.empty() ? notes : notes.substr(0, notes.size() - 1);
+}
+
+static void WriteListing(std::ostream& out, const ControlFlowGraph& graph, const std::vector<uint8_t>& image)
+{
+    const std::vector<ControlFlowGraph::Store>& stores = graph.Stores();
+    size_t nextStore = 0;
+
+    uint16_t end = graph.Origin() + image.size();
+    for (uint16_t address = graph.Origin(); address < end;)
+    {
+        if (graph.IsInstruction(address) && address + 2 <= end)
+        {
+            if (graph.IsLeader(address)) out << "\n" << Label(graph, address) << ":\n";
+
+            const ControlFlowGraph::Store* store = nullptr;
+            while (nextStore < stores.size() && stores[nextStore].address < address) nextStore++;
+            if (nextStore < stores.size() && stores[nextStore].address == address) store = &stores[nextStore];
+
+            uint16_t opcode = graph.Opcode(address);
+            std::string text = Disassemble(opcode);
+            std::string notes = Notes(graph, address, store);
+            out << "    " << Hex(address, 3) << "  " << Hex(opcode, 4).substr(2) << "  " << text;
+            if (!notes.empty()) out << std::string(text.size() < 16 ? 16 - text.size() : 1, ' ') << notes;
+            out << "\n";
+            address += 2;
+            continue;
+        }
+
+        // A run of data up to the next instruction, sprites one byte per line and the rest eight
+        out << "\n";
+        while (address < end && !graph.IsInstruction(address))
+        {
+            uint8_t byte = image[address - graph.Origin()];
+            out << "    " << Hex(address, 3) << "  ";
+            if (graph.IsSprite(address))
+            {
+                out << Hex(byte, 2).substr(2) << "    DB " << Hex(byte, 2) << "        ; ";
+                for (int bit = 7; bit >= 0; bit--) out << ((byte >> bit) & 1 ? '#' : '.');
+                out << "\n";
+                address++;
+                continue;
+            }
+
+            int count = 0;
+            std::string bytes;
+            while (count < 8 && address + count < end && !graph.IsInstruction(address + count) &&
+                   !graph.IsSprite(address + count))
+            {
+                bytes += (count ? ", " : "") + Hex(image[address + count - graph.Origin()], 2);
+                count++;
+            }
+            out << "      DB " << bytes << "\n";
+            address += count;
+        }
+    }
+}
+
+static void WriteList(std::ostream& out, const std::vector<uint16_t>& values)
+{
+    out << "[";
+    for (size_t i = 0; i < values.size(); i++) out << (i ? ", " : "") << values[i];
+    out << "]";
+}
+
+// Addresses are numbers, as the JSON of chip8_bench has them
+static void WriteCfg(std::ostream& out, const ControlFlowGraph& graph, const std::string& name)
+{
+    const std::vector<ControlFlowGraph::Block>& blocks = graph.Blocks();
+    const std::vector<ControlFlowGraph::Store>& stores = graph.Stores();
+
+    std::vector<uint16_t> subroutines;
+    std::vector<uint16_t> loops;
+    std::vector<uint16_t> indirectJumps;
+    std::vector<uint16_t> guarded;
+    for (size_t b = 0; b < blocks.size(); b++)
+    {
+        for (int k = 0; k < blocks[b].length; k++)
+        {
+            uint16_t address = blocks[b].start + 2 * k;
+            if (graph.IsSubroutine(address)) subroutines.push_back(address);
+            if (graph.IsLoopHeader(address)) loops.push_back(address);
+            if (graph.IsSkipGuarded(address)) guarded.push_back(address);
+            if (Instructions::Decode(graph.Opcode(address)) == Instructions::JP_BNNN) indirectJumps.push_back(address);
+        }
+    }
+
+    out << "{\n  \"rom\": \"" << name << "\",\n  \"origin\": " << graph.Origin() << ",\n  \"size\": " << graph.Size()
+        << ",\n  \"blocks\": [\n";
+    for (size_t b = 0; b < blocks.size(); b++)
+    {
+        const ControlFlowGraph::Block& block = blocks[b];
+        out << "    {\"start\": " << block.start << ", \"length\": " << block.length << ", \"successors\": ";
+        WriteList(out, block.successors);
+        out << ", \"indirect\": " << (block.indirect ? "true" : "false") << ", \"instructions\": [";
+        for (int k = 0; k < block.length; k++)
+        {
+            uint16_t address = block.start + 2 * k;
+            out << (k ? ", " : "") << "{\"address\": " << address << ", \"opcode\": " << graph.Opcode(address)
+                << ", \"text\": \"" << Disassemble(graph.Opcode(address)) << "\"}";
+        }
+        out << "]}" << (b + 1 < blocks.size() ? "," : "") << "\n";
+    }
+
+    out << "  ],\n  \"subroutines\": ";
+    WriteList(out, subroutines);
+    out << ",\n  \"loop_headers\": ";
+    WriteList(out, loops);
+    out << ",\n  \"skip_guarded\": ";
+    WriteList(out, guarded);
+    out << ",\n  \"indirect_jumps\": ";
+    WriteList(out, indirectJumps);
+
+    out << ",\n  \"stores\": [\n";
+    for (size_t s = 0; s < stores.size(); s++)
+    {
+        const ControlFlowGraph::Store& store = stores[s];
+        out << "    {\"address\": " << store.address << ", \"known\": " << (store.known ? "true" : "false");
+        if (store.known) out << ", \"target\": " << store.target << ", \"length\": " << store.length;
+        out << ", \"hits_code\": " << (store.hitsCode ? "true" : "false") << "}" << (s + 1 < stores.size() ? "," : "") << "\n";
+    }
+
+    // Maximal runs of bytes no instruction covers, split where sprite rows start or stop
+    out << "  ],\n  \"data\": [\n";
+    bool first = true;
+    uint16_t end = graph.Origin() + graph.Size();
+    for (uint16_t address = graph.Origin(); address < end;)
+    {
+        if (graph.IsCode(address))
+        {
+            address++;
+            continue;
+        }
+        uint16_t start = address;
+        bool sprite = graph.IsSprite(address);
+        while (address < end && !graph.IsCode(address) && graph.IsSprite(address) == sprite) address++;
+        out << (first ? "" : ",\n") << "    {\"start\": " << start << ", \"length\": " << address - start
+            << ", \"sprite\": " << (sprite ? "true" : "false") << "}";
+        first = false;
+    }
+    out << (first ? "" : "\n") << "  ]\n}\n";
+}
+
+int main(int argc, char** args)
+{
+    std::string romPath;
+    std::string cfgPath;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(args[i], "--rom") == 0) romPath = args[i + 1];
+        else if (strcmp(args[i], "--cfg") == 0) cfgPath = args[i + 1];
+    }
+
+    if (romPath.empty())
+    {
+        std::cerr << "Usage: chip8_disasm --rom <path> [--cfg <path>]" << std::endl;
+        return 1;
+    }
+    std::string name = romPath.substr(romPath.find_last_of('/') + 1);
+
+    std::ifstream rom(romPath.c_str(), std::ios::binary);
+    std::vector<uint8_t> image((std::istreambuf_iterator<char>(rom)), std::istreambuf_iterator<char>());
+    if (!rom.good() && !rom.eof())
+    {
+        std::cerr << "Failed to read ROM " << romPath << std::endl;
+        return 1;
+    }
+    if (image.empty() || image.size() > 4096 - 0x200)
+    {
+        std::cerr << "ROM " << romPath << " is empty or too large" << std::endl;
+        return 1;
+    }
+
+    ControlFlowGraph graph(&image[0], image.size());
+
+    int instructions = 0;
+    for (size_t b = 0; b < graph.Blocks().size(); b++) instructions += graph.Blocks()[b].length;
+    int codeBytes = 0;
+    int spriteBytes = 0;
+    for (size_t i = 0; i < image.size(); i++)
+    {
+        codeBytes += graph.IsCode(graph.Origin() + i);
+        spriteBytes += !graph.IsCode(graph.Origin() + i) && graph.IsSprite(graph.Origin() + i);
+    }
+
+    std::cout << "; " << name << ": " << image.size() << " bytes, " << graph.Blocks().size() << " blocks, " << instructions
+              << " instructions, " << codeBytes << " bytes of code, " << spriteBytes << " of sprites\n";
+    WriteListing(std::cout, graph, image);
+
+    if (!cfgPath.empty())
+    {
+        std::ofstream cfg(cfgPath.c_str());
+        WriteCfg(cfg, graph, name);
+        if (!cfg.good())
+        {
+            std::cerr << "Failed to write " << cfgPath << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,169 @@
+/*
+ * chip8_search: finds keypad input that drives a ROM to a goal state, with StateSearch (see
+ * Search.h), and prints it one run of frames per line.
+ *
+ * Usage: chip8_search --rom <path> --goal <target><op><value> [--mode bfs|best] [--threads <n>]
+ *                     [--max-states <n>] [--quirks <profile>]
+ *
+ * The target is a register (V0..VF, I, DT, ST) or a memory address such as 0x2F0; op is one of
+ * ==, !=, <=, >=, < and >, and `=` means ==. Best-first search expands the states whose target is
+ * closest to the value first. Exits with 0 when the goal was reached and 1 otherwise.
+ */
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Chip8.h"
+#include "Search.h"
+
+struct Goal
+{
+    enum Target
+    {
+        REGISTER,
+        INDEX,
+        DELAY,
+        SOUND,
+        MEMORY
+    };
+
+    Target target;
+    int where;
+    std::string op;
+    long value;
+
+    long Read(const Chip8& chip8) const
+    {
+        switch (target)
+        {
+            case REGISTER: return chip8.Register(where);
+            case INDEX: return chip8.IndexRegister();
+            case DELAY: return chip8.DelayTimer();
+            case SOUND: return chip8.SoundTimer();
+            default: return chip8.Read(where);
+        }
+    }
+
+    bool Reached(const Chip8& chip8) const
+    {
+        long current = Read(chip8);
+        if (op == "!=") return current != value;
+        if (op == "<=") return current <= value;
+        if (op == ">=") return current >= value;
+        if (op == "<") return current < value;
+        if (op == ">") return current > value;
+        return current == value;
+    }
+
+    // How far the target is from satisfying the goal, for best-first search
+    int Distance(const Chip8& chip8) const
+    {
+        if (Reached(chip8)) return 0;
+        long current = Read(chip8);
+        return (int)(current > value ? current - value : value - current) + 1;
+    }
+};
+
+static bool ParseGoal(const std::string& text, Goal& goal)
+{
+    size_t at = text.find_first_of("=!<>");
+    if (at == std::string::npos || at == 0) return false;
+
+    std::string target = text.substr(0, at);
+    size_t end = text.find_first_not_of("=!<>", at);
+    if (end == std::string::npos) return false;
+    goal.op = text.substr(at, end - at);
+    if (goal.op != "=" && goal.op != "==" && goal.op != "!=" && goal.op != "<=" && goal.op != ">=" && goal.op != "<" &&
+        goal.op != ">") return false;
+
+    char* rest;
+    goal.value = strtol(text.c_str() + end, &rest, 0);
+    if (*rest != '\0') return false;
+
+    if ((target[0] == 'V' || target[0] == 'v') && target.size() == 2 && isxdigit((unsigned char)target[1]))
+    {
+        goal.target = Goal::REGISTER;
+        goal.where = (int)strtol(target.c_str() + 1, nullptr, 16);
+    }
+    else if (target == "I") goal.target = Goal::INDEX;
+    else if (target == "DT") goal.target = Goal::DELAY;
+    else if (target == "ST") goal.target = Goal::SOUND;
+    else
+    {
+        goal.target = Goal::MEMORY;
+        goal.where = (int)strtol(target.c_str(), &rest, 0);
+        if (*rest != '\0' || goal.where < 0 || goal.where > 0xFFF) return false;
+    }
+    return true;
+}
+
+int main(int argc, char** args)
+{
+    std::string romPath;
+    std::string goalText;
+    std::string modeName = "bfs";
+    int threads = (int)std::thread::hardware_concurrency();
+    long maxStates = 200000;
+    QuirkProfile quirks = QUIRKS_DEFAULT;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(args[i], "--rom") == 0) romPath = args[i + 1];
+        else if (strcmp(args[i], "--goal") == 0) goalText = args[i + 1];
+        else if (strcmp(args[i], "--mode") == 0) modeName = args[i + 1];
+        else if (strcmp(args[i], "--threads") == 0) threads = atoi(args[i + 1]);
+        else if (strcmp(args[i], "--max-states") == 0) maxStates = atol(args[i + 1]);
+        else if (strcmp(args[i], "--quirks") == 0 && !ParseQuirkProfile(args[i + 1], quirks))
+        {
+            std::cerr << "Unknown quirk profile " << args[i + 1] << std::endl;
+            return 1;
+        }
+    }
+
+    Goal goal;
+    if (romPath.empty() || !ParseGoal(goalText, goal) || (modeName != "bfs" && modeName != "best") || maxStates < 1)
+    {
+        std::cerr << "Usage: chip8_search --rom <path> --goal <V0..VF|I|DT|ST|address><op><value> [--mode bfs|best]"
+                  << " [--threads <n>] [--max-states <n>] [--quirks <profile>]" << std::endl;
+        return 1;
+    }
+
+    Chip8 chip8;
+    chip8.SetQuirks(quirks);
+    if (!chip8.LoadRom(romPath.c_str())) return 1;
+
+    StateSearch search(threads);
+    search.maxStates = (size_t)maxStates;
+    if (modeName == "best")
+    {
+        search.mode = StateSearch::BEST_FIRST;
+        search.heuristic = [&goal](const Chip8& state) { return goal.Distance(state); };
+    }
+
+    std::vector<int> inputs;
+    bool found = search.Run(chip8, [&goal](const Chip8& state) { return goal.Reached(state); }, inputs);
+    std::cout << "Expanded " << search.expanded << " states, dropped " << search.duplicates << " duplicates" << std::endl;
+    if (!found)
+    {
+        std::cout << "No input reaches " << goalText << std::endl;
+        return 1;
+    }
+
+    std::cout << "Reached " << goalText << " after " << inputs.size() << " frames" << std::endl;
+    for (size_t i = 0; i < inputs.size();)
+    {
+        size_t run = 1;
+        while (i + run < inputs.size() && inputs[i + run] == inputs[i]) run++;
+
+        std::cout << "  " << run << (run == 1 ? " frame  " : " frames ");
+        if (inputs[i] == StateSearch::NO_KEY) std::cout << "no key\n";
+        else std::cout << "key " << std::hex << std::uppercase << inputs[i] << std::dec << std::nouppercase << "\n";
+        i += run;
+    }
+    return 0;
+}
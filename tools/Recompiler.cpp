@@ -0,0 +1,514 @@
+/*
+ * chip8_recompile: translates a ROM to C++ ahead of time. The control-flow graph is recovered
+ * from the image (see Analysis.h) and written out as one function per block and one per
+ * instruction, inlined into a run function that holds the timers in locals and jumps from block to
+ * block directly wherever the graph knows the next pc. The output registers itself with
+ * RecompiledEngine when linked into an executable; chip8_recompile_roms in CMakeLists.txt runs
+ * this at build time.
+ *
+ * Usage: chip8_recompile --rom <path> --out <path> [--name <name>] [--quirks <profile>]
+ * --name is what the engine reports (default: the ROM's file name) and --quirks the profile the
+ * code is specialized for (default: default).
+ */
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Analysis.h"
+#include "Instructions.h"
+
+// The profile types and enumerators of Quirks.h, by QuirkProfile
+static const char* const profileTypes[QUIRK_PROFILE_COUNT] = {"DefaultQuirks", "CosmacVipQuirks", "Chip48Quirks",
+                                                              "SchipQuirks", "XoChipQuirks"};
+static const char* const profileEnums[QUIRK_PROFILE_COUNT] = {"QUIRKS_DEFAULT", "QUIRKS_COSMAC_VIP", "QUIRKS_CHIP48",
+                                                              "QUIRKS_SCHIP", "QUIRKS_XO_CHIP"};
+
+// The quirks that decide which registers an instruction uses; the rest stay with the helpers' Q
+struct Operands
+{
+    bool shiftReadsVy;
+    bool jumpUsesVx;
+    bool logicResetsVf;
+
+    template <class Q>
+    void Run(void)
+    {
+        shiftReadsVy = Q::SHIFT_READS_VY;
+        jumpUsesVx = Q::JUMP_USES_VX;
+        logicResetsVf = Q::LOGIC_RESETS_VF;
+    }
+};
+
+static std::string Hex(int value, int digits = 0)
+{
+    char text[16];
+    snprintf(text, sizeof(text), "0x%0*X", digits, value);
+    return text;
+}
+
+// The local holding register r
+static std::string Reg(int r)
+{
+    char text[4];
+    snprintf(text, sizeof(text), "v%X", r);
+    return text;
+}
+
+// What an instruction reads and writes: registers as masks by index, and I. Writes are unconditional
+// except FX0A's, which reads its register as well so that a function holding it starts from the
+// machine's value
+struct Access
+{
+    uint16_t reads;
+    uint16_t writes;
+    bool readsIndex;
+    bool writesIndex;
+};
+
+static Access Accesses(uint16_t opcode, const Operands& quirks)
+{
+    uint16_t x = 1 << ((opcode >> 8) & 0xF);
+    uint16_t y = 1 << ((opcode >> 4) & 0xF);
+    uint16_t f = 1 << 0xF;
+    uint16_t upToX = (x << 1) - 1;
+
+    Access access = {0, 0, false, false};
+    switch (Instructions::Decode(opcode))
+    {
+        case Instructions::SE_3XKK:
+        case Instructions::SNE_4XKK:
+        case Instructions::SKP_EX9E:
+        case Instructions::SKNP_EXA1:
+        case Instructions::LD_FX15:
+        case Instructions::LD_FX18:
+            access.reads = x;
+            break;
+        case Instructions::LD_6XKK:
+        case Instructions::RND_CXKK:
+        case Instructions::LD_FX07:
+            access.writes = x;
+            break;
+        case Instructions::ADD_7XKK:
+        case Instructions::LD_FX0A:
+            access.reads = x;
+            access.writes = x;
+            break;
+        case Instructions::SE_5XY0:
+        case Instructions::SNE_9XY0:
+            access.reads = x | y;
+            break;
+        case Instructions::LD_8XY0:
+            access.reads = y;
+            access.writes = x;
+            break;
+        case Instructions::OR_8XY1:
+        case Instructions::AND_8XY2:
+        case Instructions::XOR_8XY3:
+            access.reads = x | y;
+            access.writes = x | (quirks.logicResetsVf ? f : 0);
+            break;
+        case Instructions::ADD_8XY4:
+        case Instructions::SUB_8XY5:
+        case Instructions::SUBN_8XY7:
+            access.reads = x | y;
+            access.writes = x | f;
+            break;
+        case Instructions::SHR_8XY6:
+        case Instructions::SHL_8XYE:
+            access.reads = quirks.shiftReadsVy ? y : x;
+            access.writes = x | f;
+            break;
+        case Instructions::JP_BNNN:
+            access.reads = quirks.jumpUsesVx ? x : 1;
+            break;
+        case Instructions::LD_ANNN:
+            access.writesIndex = true;
+            break;
+        case Instructions::DRW_DXYN:
+            access.reads = x | y;
+            access.writes = f;
+            access.readsIndex = true;
+            break;
+        case Instructions::ADD_FX1E:
+            access.reads = x;
+            access.readsIndex = true;
+            access.writesIndex = true;
+            break;
+        case Instructions::LD_FX29:
+            access.reads = x;
+            access.writesIndex = true;
+            break;
+        case Instructions::BCD_FX33:
+            access.reads = x;
+            access.readsIndex = true;
+            break;
+
+        // Whether these step I is a quirk of the helpers' Q, so I is taken as read and written
+        case Instructions::LD_FX55:
+            access.reads = upToX;
+            access.readsIndex = true;
+            access.writesIndex = true;
+            break;
+        case Instructions::LD_FX65:
+            access.writes = upToX;
+            access.readsIndex = true;
+            access.writesIndex = true;
+            break;
+        default: break;
+    }
+    return access;
+}
+
+// The suffix of the functions and labels generated for the instruction or block at address
+static std::string Suffix(uint16_t address)
+{
+    return Hex(address, 3).substr(2);
+}
+
+// Whether the instruction at address may write code, after which control goes back to the engine
+// so that it can check what changed; stores the graph knows to miss code carry on
+static bool MayWriteCode(const ControlFlowGraph& graph, uint16_t address)
+{
+    const std::vector<ControlFlowGraph::Store>& stores = graph.Stores();
+    for (size_t s = 0; s < stores.size(); s++)
+    {
+        if (stores[s].address == address) return !stores[s].known || stores[s].hitsCode;
+    }
+    return false;
+}
+
+// Writes code paying the timer ticks owed by the instructions run since they were last paid
+static void WriteTicks(std::ostream& out, int& ticks)
+{
+    if (ticks > 0) out << "    Instructions::Tick(delay, sound, " << ticks << ");\n";
+    ticks = 0;
+}
+
+/*
+ * Writes a function running `length` instructions of the graph from `start` and returning the next
+ * pc. The registers and I the instructions use are held in locals; those read before the function
+ * writes them are loaded on entry, and those written are stored back on exit. Timer ticks are owed
+ * until an instruction looks at the timers or the function ends, and paid in one go. The machine
+ * parameter goes unnamed when the body never touches it, so the output builds warning-free.
+ */
+static void WriteFunction(std::ostream& code, const ControlFlowGraph& graph, const Operands& quirks,
+                          const std::string& name, uint16_t start, int length)
+{
+    uint16_t loaded = 0;
+    uint16_t dirty = 0;
+    bool loadsIndex = false;
+    bool indexDirty = false;
+    for (int k = 0; k < length; k++)
+    {
+        Access access = Accesses(graph.Opcode(start + 2 * k), quirks);
+        loaded |= access.reads & ~dirty;
+        dirty |= access.writes;
+        loadsIndex |= access.readsIndex && !indexDirty;
+        indexDirty |= access.writesIndex;
+    }
+
+    std::ostringstream out;
+    for (int r = 0; r < 16; r++)
+    {
+        if (loaded & (1 << r)) out << "    uint8_t " << Reg(r) << " = Instructions::V(chip8)[" << Hex(r) << "];\n";
+        else if (dirty & (1 << r)) out << "    uint8_t " << Reg(r) << ";\n";
+    }
+    if (loadsIndex) out << "    uint16_t i = Instructions::I(chip8);\n";
+    else if (indexDirty) out << "    uint16_t i;\n";
+    bool declared = loaded != 0 || dirty != 0 || loadsIndex || indexDirty;
+
+    int ticks = 0;
+    std::string next;
+    for (int k = 0; k < length; k++)
+    {
+        uint16_t address = start + 2 * k;
+        uint16_t opcode = graph.Opcode(address);
+        int xi = (opcode >> 8) & 0xF;
+        std::string x = Reg(xi);
+        std::string y = Reg((opcode >> 4) & 0xF);
+        std::string f = Reg(0xF);
+        std::string kk = Hex(opcode & 0xFF, 2);
+        std::string nnn = Hex(opcode & 0xFFF, 3);
+        std::string skip = Hex(address + 4, 3);
+        std::string noSkip = Hex(address + 2, 3);
+        std::string shifted = quirks.shiftReadsVy ? y : x;
+
+        if (k > 0 || declared) out << "\n";
+        out << "    // " << Hex(address, 3) << ": " << Hex(opcode, 4).substr(2) << "  " << Disassemble(opcode) << "\n";
+
+        Instructions::Kind kind = Instructions::Decode(opcode);
+        if (kind == Instructions::LD_FX07 || kind == Instructions::LD_FX15 || kind == Instructions::LD_FX18) WriteTicks(out, ticks);
+
+        switch (kind)
+        {
+            case Instructions::CLS_00E0: out << "    Instructions::Clear(chip8);\n"; break;
+            case Instructions::RET_00EE:
+                out << "    Instructions::Return(chip8);\n";
+                next = "Instructions::PC(chip8)";
+                break;
+            case Instructions::JP_1NNN: next = nnn; break;
+            case Instructions::CALL_2NNN:
+                out << "    Instructions::PC(chip8) = " << Hex(address, 3) << ";\n"
+                    << "    Instructions::Call(chip8, " << nnn << ");\n";
+                next = nnn;
+                break;
+            case Instructions::SE_3XKK: next = x + " == " + kk + " ? " + skip + " : " + noSkip; break;
+            case Instructions::SNE_4XKK: next = x + " != " + kk + " ? " + skip + " : " + noSkip; break;
+            case Instructions::SE_5XY0: next = x + " == " + y + " ? " + skip + " : " + noSkip; break;
+            case Instructions::LD_6XKK: out << "    " << x << " = " << kk << ";\n"; break;
+            case Instructions::ADD_7XKK: out << "    " << x << " += " << kk << ";\n"; break;
+            case Instructions::LD_8XY0: out << "    " << x << " = " << y << ";\n"; break;
+
+            case Instructions::OR_8XY1:
+            case Instructions::AND_8XY2:
+            case Instructions::XOR_8XY3:
+            {
+                const char* op = kind == Instructions::OR_8XY1 ? " |= " : kind == Instructions::AND_8XY2 ? " &= " : " ^= ";
+                out << "    " << x << op << y << ";\n";
+                if (quirks.logicResetsVf) out << "    " << f << " = 0;\n";
+                break;
+            }
+
+            // VF is written before the result, as Update orders it, so x or y == F behaves the same
+            case Instructions::ADD_8XY4: out << "    " << f << " = " << x << " + " << y << " < 256 ? 0 : 1;\n    " << x << " += " << y << ";\n"; break;
+            case Instructions::SUB_8XY5: out << "    " << f << " = " << x << " < " << y << " ? 0 : 1;\n    " << x << " -= " << y << ";\n"; break;
+            case Instructions::SHR_8XY6: out << "    " << f << " = " << shifted << " & 0x1;\n    " << x << " = " << shifted << " >> 1;\n"; break;
+            case Instructions::SUBN_8XY7: out << "    " << f << " = " << y << " < " << x << " ? 0 : 1;\n    " << x << " = " << y << " - " << x << ";\n"; break;
+            case Instructions::SHL_8XYE: out << "    " << f << " = " << shifted << " >> 7;\n    " << x << " = " << shifted << " << 1;\n"; break;
+
+            case Instructions::SNE_9XY0: next = x + " != " + y + " ? " + skip + " : " + noSkip; break;
+            case Instructions::LD_ANNN: out << "    i = " << nnn << ";\n"; break;
+            case Instructions::JP_BNNN: next = nnn + " + " + (quirks.jumpUsesVx ? x : Reg(0)); break;
+            case Instructions::RND_CXKK: out << "    " << x << " = Instructions::Random(chip8) & " << kk << ";\n"; break;
+            case Instructions::DRW_DXYN:
+                out << "    " << f << " = Instructions::Draw<Q>(chip8, " << x << ", " << y << ", i, " << (opcode & 0xF) << ");\n";
+                break;
+            case Instructions::SKP_EX9E: next = "Instructions::KeyPressed(chip8, " + x + ") ? " + skip + " : " + noSkip; break;
+            case Instructions::SKNP_EXA1: next = "Instructions::KeyPressed(chip8, " + x + ") ? " + noSkip + " : " + skip; break;
+            case Instructions::LD_FX07: out << "    " << x << " = delay;\n"; break;
+            case Instructions::LD_FX0A: next = "Instructions::WaitKey(chip8, " + x + ", " + Hex(address, 3) + ")"; break;
+            case Instructions::LD_FX15: out << "    delay = " << x << ";\n"; break;
+            case Instructions::LD_FX18: out << "    sound = " << x << ";\n"; break;
+            case Instructions::ADD_FX1E: out << "    i += " << x << ";\n"; break;
+            case Instructions::LD_FX29: out << "    i = 5 * " << x << ";\n"; break;
+            case Instructions::BCD_FX33: out << "    Instructions::Bcd(chip8, i, " << x << ");\n"; break;
+
+            // The helpers loop over V, so the registers go through the machine's own
+            case Instructions::LD_FX55:
+                for (int r = 0; r <= xi; r++) out << "    Instructions::V(chip8)[" << Hex(r) << "] = " << Reg(r) << ";\n";
+                out << "    Instructions::Store<Q>(chip8, Instructions::V(chip8), i, " << xi << ");\n";
+                break;
+            case Instructions::LD_FX65:
+                out << "    Instructions::Load<Q>(chip8, Instructions::V(chip8), i, " << xi << ");\n";
+                for (int r = 0; r <= xi; r++) out << "    " << Reg(r) << " = Instructions::V(chip8)[" << Hex(r) << "];\n";
+                break;
+
+            // The graph holds no opcodes Update does not know
+            default: break;
+        }
+
+        if (!next.empty()) out << "    uint16_t next = " << next << ";\n";
+        ticks++;
+    }
+
+    out << "\n";
+    WriteTicks(out, ticks);
+    for (int r = 0; r < 16; r++)
+    {
+        if (dirty & (1 << r)) out << "    Instructions::V(chip8)[" << Hex(r) << "] = " << Reg(r) << ";\n";
+    }
+    if (indexDirty) out << "    Instructions::I(chip8) = i;\n";
+    out << "    return " << (next.empty() ? Hex(start + 2 * length, 3) : "next") << ";\n";
+
+    std::string body = out.str();
+    code << "uint16_t " << name << "(Chip8&" << (body.find("chip8") != std::string::npos ? " chip8" : "")
+         << ", uint8_t& delay, uint8_t& sound)\n{\n" << body << "}\n\n";
+}
+
+/*
+ * Writes the run function RecompiledProgram describes. The timers live in its locals, so the ticks
+ * of a loop that does nothing else stay out of memory.
+ *
+ * A block the budget covers runs its block function and jumps straight to whichever of its static
+ * successors pc turned out to be; anything else goes back through the switch on pc, whose default
+ * returns to the engine. A block the budget does not cover, or a pc inside a block, runs through
+ * the block's step functions, which check the budget before each instruction. Stores that may hit
+ * code return to the engine so that it can look at what they wrote. Each function is called from
+ * one place, so the compiler inlines them all here.
+ */
+static void WriteRun(std::ostream& out, const ControlFlowGraph& graph)
+{
+    const std::vector<ControlFlowGraph::Block>& blocks = graph.Blocks();
+
+    // With no blocks nothing checks valid[]
+    out << "long Run(Chip8& chip8, uint16_t& pc, long count, const uint8_t*" << (blocks.empty() ? "" : " valid") << ")\n{\n"
+        << "    uint8_t delay = Instructions::DelayTimer(chip8);\n"
+        << "    uint8_t sound = Instructions::SoundTimer(chip8);\n\n"
+        << "dispatch:\n    switch (pc)\n    {\n";
+    for (size_t b = 0; b < blocks.size(); b++)
+    {
+        out << "        case " << Hex(blocks[b].start, 3) << ": goto block_" << Suffix(blocks[b].start) << ";\n";
+        for (int k = 1; k < blocks[b].length; k++)
+        {
+            uint16_t address = blocks[b].start + 2 * k;
+            out << "        case " << Hex(address, 3) << ": goto step_" << Suffix(address) << ";\n";
+        }
+    }
+    out << "        default: goto done;\n    }\n";
+
+    for (size_t b = 0; b < blocks.size(); b++)
+    {
+        const ControlFlowGraph::Block& block = blocks[b];
+        uint16_t last = block.start + 2 * (block.length - 1);
+
+        out << "\nblock_" << Suffix(block.start) << ":\n"
+            << "    if (!valid[" << b << "]) goto done;\n"
+            << "    if (count < " << block.length << ") goto step_" << Suffix(block.start) << ";\n"
+            << "    pc = Block_" << Suffix(block.start) << "(chip8, delay, sound);\n"
+            << "    count -= " << block.length << ";\n";
+
+        std::vector<uint16_t> targets;
+        for (size_t t = 0; t < block.successors.size(); t++)
+        {
+            uint16_t target = block.successors[t];
+            if (graph.IsLeader(target) && graph.IsInstruction(target)) targets.push_back(target);
+        }
+
+        if (MayWriteCode(graph, last)) out << "    goto done;\n";
+        else if (!block.indirect && block.successors.size() == 1 && targets.size() == 1)
+        {
+            out << "    goto block_" << Suffix(targets[0]) << ";\n";
+        }
+        else
+        {
+            // A call's return site is among its successors but is not where the call goes, hence the compare
+            for (size_t t = 0; t < targets.size(); t++)
+            {
+                out << "    if (pc == " << Hex(targets[t], 3) << ") goto block_" << Suffix(targets[t]) << ";\n";
+            }
+            out << "    goto dispatch;\n";
+        }
+
+        // Only the last instruction can leave the block, so each step falls through to the next
+        for (int k = 0; k < block.length; k++)
+        {
+            uint16_t address = block.start + 2 * k;
+            std::string step = "Step_" + Suffix(address) + "(chip8, delay, sound);\n";
+            out << "step_" << Suffix(address) << ":\n"
+                << "    if (count == 0 || !valid[" << b << "])\n    {\n"
+                << "        pc = " << Hex(address, 3) << ";\n        goto done;\n    }\n";
+            if (address != last) out << "    " << step << "    count--;\n";
+            else out << "    pc = " << step << "    count--;\n    goto " << (MayWriteCode(graph, last) ? "done" : "dispatch") << ";\n";
+        }
+    }
+
+    out << "\ndone:\n"
+        << "    Instructions::DelayTimer(chip8) = delay;\n"
+        << "    Instructions::SoundTimer(chip8) = sound;\n"
+        << "    return count;\n}\n\n";
+}
+
+int main(int argc, char** args)
+{
+    std::string romPath;
+    std::string outPath;
+    std::string name;
+    std::string quirksName = "default";
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(args[i], "--rom") == 0) romPath = args[i + 1];
+        else if (strcmp(args[i], "--out") == 0) outPath = args[i + 1];
+        else if (strcmp(args[i], "--name") == 0) name = args[i + 1];
+        else if (strcmp(args[i], "--quirks") == 0) quirksName = args[i + 1];
+    }
+
+    if (romPath.empty() || outPath.empty())
+    {
+        std::cerr << "Usage: chip8_recompile --rom <path> --out <path> [--name <name>] [--quirks <profile>]" << std::endl;
+        return 1;
+    }
+    if (name.empty()) name = romPath.substr(romPath.find_last_of('/') + 1);
+
+    QuirkProfile profile;
+    if (!ParseQuirkProfile(quirksName, profile))
+    {
+        std::cerr << "Unknown quirk profile " << quirksName << std::endl;
+        return 1;
+    }
+    Operands quirks;
+    VisitQuirks(profile, BOUNDS_WRAP, quirks);
+
+    std::ifstream rom(romPath.c_str(), std::ios::binary);
+    std::vector<uint8_t> image((std::istreambuf_iterator<char>(rom)), std::istreambuf_iterator<char>());
+    if (!rom.good() && !rom.eof())
+    {
+        std::cerr << "Failed to read ROM " << romPath << std::endl;
+        return 1;
+    }
+    if (image.empty() || image.size() > 4096 - 0x200)
+    {
+        std::cerr << "ROM " << romPath << " is empty or too large" << std::endl;
+        return 1;
+    }
+
+    ControlFlowGraph graph(&image[0], image.size());
+    const std::vector<ControlFlowGraph::Block>& blocks = graph.Blocks();
+
+    std::ostringstream code;
+    code << "// Generated by chip8_recompile from " << name << " for the " << QuirkProfileName(profile)
+         << " quirk profile; do not edit\n"
+         << "#include \"Instructions.h\"\n#include \"RecompiledEngine.h\"\n\n"
+         << "namespace\n{\n\n"
+         << "typedef Bounded<" << profileTypes[profile] << ", BOUNDS_WRAP> Q;\n\n"
+         << "const uint8_t image[] = {";
+    for (size_t i = 0; i < image.size(); i++) code << (i % 12 == 0 ? "\n    " : " ") << Hex(image[i], 2) << ",";
+    code << "\n};\n\n";
+
+    int instructions = 0;
+    int indirect = 0;
+    for (size_t b = 0; b < blocks.size(); b++)
+    {
+        const ControlFlowGraph::Block& block = blocks[b];
+        WriteFunction(code, graph, quirks, "Block_" + Suffix(block.start), block.start, block.length);
+        for (int k = 0; k < block.length; k++)
+        {
+            uint16_t address = block.start + 2 * k;
+            WriteFunction(code, graph, quirks, "Step_" + Suffix(address), address, 1);
+        }
+        instructions += block.length;
+        indirect += block.indirect;
+    }
+
+    WriteRun(code, graph);
+
+    if (!blocks.empty())
+    {
+        code << "const RecompiledBlock blocks[] = {\n";
+        for (size_t b = 0; b < blocks.size(); b++) code << "    {" << Hex(blocks[b].start, 3) << ", " << blocks[b].length << "},\n";
+        code << "};\n\n";
+    }
+
+    code << "const RecompiledProgram program = {\"" << name << "\", image, sizeof(image), " << Hex(graph.Origin(), 3) << ", "
+         << profileEnums[profile] << ", " << (blocks.empty() ? "nullptr" : "blocks") << ", " << blocks.size() << ", &Run};\n\n"
+         << "struct Registrar\n{\n    Registrar(void) { RecompiledEngine::Register(&program); }\n} registrar;\n\n"
+         << "}\n";
+
+    std::ofstream out(outPath.c_str());
+    out << code.str();
+    if (!out.good())
+    {
+        std::cerr << "Failed to write " << outPath << std::endl;
+        return 1;
+    }
+
+    std::cout << name << ": " << blocks.size() << " blocks, " << instructions << " instructions, "
+              << indirect << " blocks ending in an indirect jump, return or key wait" << std::endl;
+    return 0;
+}